@@ -0,0 +1,140 @@
+#include "calibrationCache.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <sys/stat.h>
+#include <opencv2/opencv.hpp>
+
+// Constructor
+CalibrationCache::CalibrationCache()
+{
+  const char * xdg  = std::getenv("XDG_CACHE_HOME");
+  const char * home = std::getenv("HOME");
+
+  if (xdg && *xdg)
+    directory = std::string(xdg) + "/perceptor";
+  else if (home && *home)
+    directory = std::string(home) + "/.cache/perceptor";
+}
+
+bool CalibrationCache::get(const rs2::device & dev, int width, int height, StereoCalibration & calib)
+{
+  std::string serial(dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
+
+  if (load(serial, width, height, calib))
+    return(true);
+
+  if (!query(dev, width, height, calib))
+    return(false);
+
+  save(serial, calib);
+  return(true);
+}
+
+bool CalibrationCache::load(const std::string & serial, int width, int height, StereoCalibration & calib)
+{
+  if (directory.empty())
+    return(false);
+
+  cv::FileStorage fs(path(serial), cv::FileStorage::READ);
+  if (!fs.isOpened())
+    return(false);
+
+  if ((int)fs["width"] != width || (int)fs["height"] != height)
+    return(false);
+
+  calib.intrinsics.width  = width;
+  calib.intrinsics.height = height;
+  calib.intrinsics.model  = (rs2_distortion)(int)fs["model"];
+  calib.intrinsics.fx     = (float)(double)fs["fx"];
+  calib.intrinsics.fy     = (float)(double)fs["fy"];
+  calib.intrinsics.ppx    = (float)(double)fs["ppx"];
+  calib.intrinsics.ppy    = (float)(double)fs["ppy"];
+  calib.intrinsics.coeffs[0] = (float)(double)fs["k1"];
+  calib.intrinsics.coeffs[1] = (float)(double)fs["k2"];
+  calib.intrinsics.coeffs[2] = (float)(double)fs["p1"];
+  calib.intrinsics.coeffs[3] = (float)(double)fs["p2"];
+  calib.intrinsics.coeffs[4] = (float)(double)fs["k3"];
+  calib.baseline   = (float)(double)fs["baseline"];
+  calib.depthScale = (float)(double)fs["depth_scale"];
+
+  return(calib.intrinsics.fx > 0.0f && calib.depthScale > 0.0f);
+}
+
+bool CalibrationCache::save(const std::string & serial, const StereoCalibration & calib)
+{
+  if (directory.empty())
+    return(false);
+
+  // Create the directory hierarchy if missing
+  for (size_t p = directory.find('/', 1); ; p = directory.find('/', p + 1)) {
+    mkdir(directory.substr(0, p).c_str(), 0755);
+    if (p == std::string::npos)
+      break;
+  }
+
+  cv::FileStorage fs(path(serial), cv::FileStorage::WRITE);
+  if (!fs.isOpened()) {
+    std::cerr << "Unable to write the calibration cache " << path(serial) << std::endl;
+    return(false);
+  }
+
+  fs << "width"  << calib.intrinsics.width;
+  fs << "height" << calib.intrinsics.height;
+  fs << "model"  << (int)calib.intrinsics.model;
+  fs << "fx"     << (double)calib.intrinsics.fx;
+  fs << "fy"     << (double)calib.intrinsics.fy;
+  fs << "ppx"    << (double)calib.intrinsics.ppx;
+  fs << "ppy"    << (double)calib.intrinsics.ppy;
+  fs << "k1"     << (double)calib.intrinsics.coeffs[0];
+  fs << "k2"     << (double)calib.intrinsics.coeffs[1];
+  fs << "p1"     << (double)calib.intrinsics.coeffs[2];
+  fs << "p2"     << (double)calib.intrinsics.coeffs[3];
+  fs << "k3"     << (double)calib.intrinsics.coeffs[4];
+  fs << "baseline"    << (double)calib.baseline;
+  fs << "depth_scale" << (double)calib.depthScale;
+  fs.release();
+
+  return(true);
+}
+
+// Intrinsics and extrinsics are part of the stream profiles: no need to
+// start streaming the IR right camera to get the baseline.
+bool CalibrationCache::query(const rs2::device & dev, int width, int height, StereoCalibration & calib)
+{
+  auto depth_sensor = dev.first<rs2::depth_sensor>();
+
+  rs2::stream_profile irLeft, irRight, depth;
+  for (auto&& p : depth_sensor.get_stream_profiles())
+  {
+    if (!p.is<rs2::video_stream_profile>())
+      continue;
+
+    auto vp = p.as<rs2::video_stream_profile>();
+    if (vp.width() != width || vp.height() != height)
+      continue;
+
+    if (p.stream_type() == RS2_STREAM_INFRARED && p.stream_index() == 1 && !irLeft)
+      irLeft = p;
+    else if (p.stream_type() == RS2_STREAM_INFRARED && p.stream_index() == 2 && !irRight)
+      irRight = p;
+    else if (p.stream_type() == RS2_STREAM_DEPTH && !depth)
+      depth = p;
+  }
+
+  if (!irLeft || !irRight || !depth) {
+    std::cerr << "Stereo stream profiles not available at " << width << "x" << height << "." << std::endl;
+    return(false);
+  }
+
+  calib.intrinsics = irLeft.as<rs2::video_stream_profile>().get_intrinsics();
+  calib.baseline   = depth.get_extrinsics_to(irRight).translation[0];
+  calib.depthScale = depth_sensor.get_depth_scale();
+
+  return(true);
+}
+
+std::string CalibrationCache::path(const std::string & serial)
+{
+  return(directory + "/" + serial + ".yml");
+}
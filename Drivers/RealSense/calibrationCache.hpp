@@ -0,0 +1,39 @@
+#ifndef __CALIBRATIONCACHE__
+#define __CALIBRATIONCACHE__
+
+#include <string>
+#include <librealsense2/rs.hpp>
+
+// Stereo calibration of a depth camera, as needed by the IRD modality
+struct StereoCalibration {
+  rs2_intrinsics intrinsics; // IR left
+  float baseline;            // depth to IR right translation along x [m]
+  float depthScale;          // [m] per depth unit
+};
+
+// On-disk cache of the device calibrations, one file per serial number in
+// $XDG_CACHE_HOME/perceptor (~/.cache/perceptor by default). Calibrations are
+// read from the device stream profiles, without streaming, on a cache miss.
+class CalibrationCache
+{
+private:
+  std::string directory;
+
+public:
+  // Constructor
+  CalibrationCache();
+
+  // Cached calibration, or read from the device (and cached) on a miss
+  bool get(const rs2::device &, int, int, StereoCalibration &);
+
+  bool load(const std::string &, int, int, StereoCalibration &);
+  bool save(const std::string &, const StereoCalibration &);
+
+  // Reads the calibration from the device stream profiles
+  static bool query(const rs2::device &, int, int, StereoCalibration &);
+
+private:
+  std::string path(const std::string &);
+};
+
+#endif // __CALIBRATIONCACHE__
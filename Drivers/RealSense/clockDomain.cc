@@ -0,0 +1,157 @@
+#include "clockDomain.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+// Drift larger than this (1000 ppm) is a bad fit, not a real clock
+static const double MAX_DRIFT = 1e-3;
+
+// Constructor
+ClockDomain::ClockDomain()
+{
+  reset();
+}
+
+void ClockDomain::reset()
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  bucketCount = 0;
+  bucketHead  = -1;
+  bucketStart = 0.0;
+  origin = 0.0;
+  offset = 0.0;
+  drift  = 0.0;
+  valid  = false;
+}
+
+rs2_time_t ClockDomain::update(const rs2::frame & f)
+{
+  rs2_time_t ts = f.get_timestamp();
+  rs2_timestamp_domain domain = f.get_frame_timestamp_domain();
+
+  if (domain == RS2_TIMESTAMP_DOMAIN_HARDWARE_CLOCK)
+    observe(ts, arrival(f));
+
+  return(toCommon(ts, domain));
+}
+
+void ClockDomain::observe(rs2_time_t deviceTs, rs2_time_t hostTs)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  const double residual = hostTs - deviceTs;
+
+  // The device clock restarted (e.g. after a pipeline restart)
+  if (bucketCount > 0 && deviceTs < bucketStart - BUCKET_MS) {
+    bucketCount = 0;
+    bucketHead  = -1;
+  }
+
+  if (bucketCount == 0 || deviceTs - bucketStart >= BUCKET_MS) {
+    bucketHead  = (bucketHead + 1) % BUCKETS;
+    bucketCount = std::min(bucketCount + 1, BUCKETS);
+    bucketStart = deviceTs;
+    bucketDevice[bucketHead]   = deviceTs;
+    bucketResidual[bucketHead] = residual;
+  } else if (residual < bucketResidual[bucketHead]) {
+    bucketDevice[bucketHead]   = deviceTs;
+    bucketResidual[bucketHead] = residual;
+  }
+
+  fit();
+}
+
+// Least squares line through the bucket minima (called with mtx held). The
+// bucket being filled is left out once there are enough complete ones: with
+// few samples its minimum is still well above the envelope, which matters
+// for low rate streams (e.g. PX4 Timesync).
+void ClockDomain::fit()
+{
+  const int skip = (bucketCount > 2) ? bucketHead : -1;
+  const int n = (skip >= 0) ? bucketCount - 1 : bucketCount;
+
+  double mx = 0.0, mr = 0.0;
+  for (int i = 0; i < bucketCount; i++) {
+    if (i == skip)
+      continue;
+    mx += bucketDevice[i];
+    mr += bucketResidual[i];
+  }
+  mx /= n;
+  mr /= n;
+
+  double sxx = 0.0, sxr = 0.0;
+  for (int i = 0; i < bucketCount; i++) {
+    if (i == skip)
+      continue;
+    const double dx = bucketDevice[i] - mx;
+    sxx += dx * dx;
+    sxr += dx * (bucketResidual[i] - mr);
+  }
+
+  origin = mx;
+  offset = mr;
+  drift  = (sxx > 0.0) ? sxr / sxx : 0.0;
+  if (std::fabs(drift) > MAX_DRIFT)
+    drift = 0.0;
+  valid  = true;
+}
+
+rs2_time_t ClockDomain::toCommon(rs2_time_t ts, rs2_timestamp_domain domain) const
+{
+  if (domain == RS2_TIMESTAMP_DOMAIN_SYSTEM_TIME || domain == RS2_TIMESTAMP_DOMAIN_GLOBAL_TIME)
+    return(ts + systemToCommon());
+
+  std::lock_guard<std::mutex> lock(mtx);
+  if (!valid)
+    return(ts);
+
+  return(ts + offset + drift * (ts - origin));
+}
+
+rs2_time_t ClockDomain::fromCommon(rs2_time_t ts) const
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  if (!valid)
+    return(ts);
+
+  return((ts - offset + drift * origin) / (1.0 + drift));
+}
+
+bool ClockDomain::isValid() const
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  return(valid);
+}
+
+double ClockDomain::getOffset() const
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  return(offset);
+}
+
+double ClockDomain::getDrift() const
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  return(drift);
+}
+
+rs2_time_t ClockDomain::now()
+{
+  return(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// librealsense stamps the arrival of each frame on the host system clock
+rs2_time_t ClockDomain::arrival(const rs2::frame & f)
+{
+  if (f.supports_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL))
+    return((rs2_time_t)f.get_frame_metadata(RS2_FRAME_METADATA_TIME_OF_ARRIVAL) + systemToCommon());
+
+  return(now());
+}
+
+double ClockDomain::systemToCommon()
+{
+  const double system = std::chrono::duration<double, std::milli>(std::chrono::system_clock::now().time_since_epoch()).count();
+  return(now() - system);
+}
@@ -0,0 +1,74 @@
+#ifndef __CLOCKDOMAIN__
+#define __CLOCKDOMAIN__
+
+#include <mutex>
+#include <librealsense2/rs.hpp>
+
+// Maps the timestamps of one device into the common time base of the
+// perceptor: the host monotonic clock (std::chrono::steady_clock), in ms.
+//
+// HARDWARE_CLOCK timestamps are mapped with an online affine model
+// host = device + offset + drift * (device - origin), fitted on the arrival
+// times of the frames. Transport latency only ever delays an arrival, so the
+// model follows the lower envelope of (arrival - device): the minimum of each
+// one second bucket is kept and a least squares line is fitted through the
+// last bucket minima. SYSTEM_TIME and GLOBAL_TIME timestamps are already on
+// the host system clock and only need the system to steady clock shift.
+class ClockDomain
+{
+public:
+  static const int BUCKETS = 16;
+  static const int BUCKET_MS = 1000;
+
+private:
+  mutable std::mutex mtx;
+
+  // Bucket minima of (arrival - device), as (device, residual) pairs
+  double bucketDevice[BUCKETS];
+  double bucketResidual[BUCKETS];
+  int    bucketCount;
+  int    bucketHead;
+  double bucketStart;
+
+  // Model
+  double origin;
+  double offset;
+  double drift;
+  bool   valid;
+
+public:
+  // Constructor
+  ClockDomain();
+
+  void reset();
+
+  // Records the arrival of a frame and returns its timestamp in the common
+  // domain. Must be called as soon as the frame is received.
+  rs2_time_t update(const rs2::frame &);
+
+  // Records a device timestamp received at the given host time [ms]. Any
+  // remote clock can be fitted this way (e.g. PX4 time from Timesync).
+  void observe(rs2_time_t, rs2_time_t);
+
+  // Device timestamp to common domain, and back (hardware clock only)
+  rs2_time_t toCommon(rs2_time_t, rs2_timestamp_domain) const;
+  rs2_time_t fromCommon(rs2_time_t) const;
+
+  bool isValid() const;
+  double getOffset() const;
+  double getDrift() const;
+
+  // Common domain clock
+  static rs2_time_t now();
+
+  // Host arrival time of a frame in the common domain
+  static rs2_time_t arrival(const rs2::frame &);
+
+  // Offset from the host system clock to the common domain [ms]
+  static double systemToCommon();
+
+private:
+  void fit();
+};
+
+#endif // __CLOCKDOMAIN__
@@ -0,0 +1,91 @@
+#include "depthPostProcessor.hpp"
+
+#include <iostream>
+
+// Constructor
+DepthPostProcessor::DepthPostProcessor():
+depthToDisparity(true), disparityToDepth(false)
+{}
+
+// Builds the chain of the enabled filters
+void DepthPostProcessor::configure(const DepthFilterConfig & _settings)
+{
+  settings = _settings;
+  chain.clear();
+
+  if (settings.decimation > 1) {
+    decimation.set_option(RS2_OPTION_FILTER_MAGNITUDE, (float)settings.decimation);
+    chain.push_back(&decimation);
+  }
+
+  if (settings.minDistance > 0.0f || settings.maxDistance > 0.0f) {
+    threshold.set_option(RS2_OPTION_MIN_DISTANCE, settings.minDistance);
+    if (settings.maxDistance > 0.0f)
+      threshold.set_option(RS2_OPTION_MAX_DISTANCE, settings.maxDistance);
+    chain.push_back(&threshold);
+  }
+
+  // Spatial and temporal filters work best in the disparity domain
+  if (settings.spatial || settings.temporal)
+    chain.push_back(&depthToDisparity);
+
+  if (settings.spatial) {
+    spatial.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, settings.spatialAlpha);
+    spatial.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, settings.spatialDelta);
+    chain.push_back(&spatial);
+  }
+
+  if (settings.temporal) {
+    temporal.set_option(RS2_OPTION_FILTER_SMOOTH_ALPHA, settings.temporalAlpha);
+    temporal.set_option(RS2_OPTION_FILTER_SMOOTH_DELTA, settings.temporalDelta);
+    chain.push_back(&temporal);
+  }
+
+  if (settings.spatial || settings.temporal)
+    chain.push_back(&disparityToDepth);
+
+  if (settings.holeFilling >= 0) {
+    holeFilling.set_option(RS2_OPTION_HOLES_FILL, (float)settings.holeFilling);
+    chain.push_back(&holeFilling);
+  }
+}
+
+bool DepthPostProcessor::isEnabled()
+{
+  return(!chain.empty());
+}
+
+int DepthPostProcessor::getDecimation()
+{
+  return(settings.decimation > 1 ? settings.decimation : 1);
+}
+
+// Runs the enabled filters in order
+rs2::frameset DepthPostProcessor::process(const rs2::frameset & fs)
+{
+  rs2::frame f = fs;
+  for (auto filter : chain)
+    f = filter->process(f);
+
+  return(rs2::frameset(f));
+}
+
+// The IR image must have the depth geometry for TrackIRD
+FrameHandle DepthPostProcessor::matchDepth(const rs2::frame & ir, const rs2::frame & depth)
+{
+  FrameHandle irHandle = FrameHandle::fromFrame(ir, CV_8UC1);
+  if (irHandle.empty() || !depth)
+    return(irHandle);
+
+  rs2::video_frame vf = depth.as<rs2::video_frame>();
+  if (irHandle.view.cols == vf.get_width() && irHandle.view.rows == vf.get_height())
+    return(irHandle);
+
+  // Reuse the buffer unless a consumer still holds the previous image
+  if (!irBuffer || irBuffer.use_count() > 1)
+    irBuffer = std::make_shared<cv::Mat>();
+
+  cv::resize(irHandle.view, *irBuffer, cv::Size(vf.get_width(), vf.get_height()), 0, 0, cv::INTER_AREA);
+
+  return(FrameHandle(*irBuffer, irBuffer, irHandle.timestamp, irHandle.frameNumber, irHandle.domain));
+}
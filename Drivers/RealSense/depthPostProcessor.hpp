@@ -0,0 +1,53 @@
+#ifndef __DEPTHPOSTPROCESSOR__
+#define __DEPTHPOSTPROCESSOR__
+
+#include <memory>
+#include <vector>
+#include <librealsense2/rs.hpp>
+#include <opencv2/opencv.hpp>
+#include "frameSource.hpp"
+
+// Depth post-processing chain built from the librealsense filters:
+// decimation -> threshold -> [depth to disparity -> spatial -> temporal ->
+// disparity to depth] -> hole filling, with only the enabled stages.
+// Framesets go through as a whole: the filters only touch the depth frame.
+// The temporal filter keeps state, so a processor must see the framesets in
+// order and from a single thread.
+class DepthPostProcessor
+{
+private:
+  DepthFilterConfig settings;
+
+  rs2::decimation_filter decimation;
+  rs2::threshold_filter threshold;
+  rs2::disparity_transform depthToDisparity;
+  rs2::disparity_transform disparityToDepth;
+  rs2::spatial_filter spatial;
+  rs2::temporal_filter temporal;
+  rs2::hole_filling_filter holeFilling;
+
+  // Enabled stages, in order
+  std::vector<rs2::filter *> chain;
+
+  // Infrared buffer resized to the decimated depth geometry
+  std::shared_ptr<cv::Mat> irBuffer;
+
+public:
+  // Constructor
+  DepthPostProcessor();
+
+  // Builds the chain from the settings
+  void configure(const DepthFilterConfig &);
+
+  bool isEnabled();
+  int getDecimation();
+
+  // Runs the chain on the depth frame of a frameset
+  rs2::frameset process(const rs2::frameset &);
+
+  // Infrared frame in the depth geometry: the frame itself when sizes
+  // already match, an area-resized copy otherwise
+  FrameHandle matchDepth(const rs2::frame &, const rs2::frame &);
+};
+
+#endif // __DEPTHPOSTPROCESSOR__
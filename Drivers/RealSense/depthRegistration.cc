@@ -0,0 +1,141 @@
+#include "depthRegistration.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+// Constructor
+DepthRegistration::DepthRegistration():
+depthWidth(0), depthHeight(0), colorWidth(0), colorHeight(0), depthScale(0.001f), initialized(false)
+{}
+
+// Precomputes, for each depth pixel, its deprojected ray rotated into the
+// color camera frame: p_color = z * (R * ray) + t.
+void DepthRegistration::initialize(const rs2_intrinsics & depthIntrinsics, const rs2_intrinsics & colorIntrinsics, const rs2_extrinsics & depthToColor, float _depthScale)
+{
+  depthWidth  = depthIntrinsics.width;
+  depthHeight = depthIntrinsics.height;
+  colorWidth  = colorIntrinsics.width;
+  colorHeight = colorIntrinsics.height;
+  depthScale  = _depthScale;
+
+  fx  = colorIntrinsics.fx;
+  fy  = colorIntrinsics.fy;
+  ppx = colorIntrinsics.ppx;
+  ppy = colorIntrinsics.ppy;
+  for (int i = 0; i < 5; i++)
+    coeffs[i] = colorIntrinsics.coeffs[i];
+  distorted = (colorIntrinsics.model == RS2_DISTORTION_MODIFIED_BROWN_CONRADY);
+
+  // Extrinsics rotation is stored column major
+  const float * R = depthToColor.rotation;
+  tx = depthToColor.translation[0];
+  ty = depthToColor.translation[1];
+  tz = depthToColor.translation[2];
+
+  const size_t n = (size_t)depthWidth * depthHeight;
+  rayX.resize(n);
+  rayY.resize(n);
+  rayZ.resize(n);
+  target.resize(n);
+
+  for (int v = 0; v < depthHeight; v++)
+  {
+    for (int u = 0; u < depthWidth; u++)
+    {
+      float x = (u - depthIntrinsics.ppx) / depthIntrinsics.fx;
+      float y = (v - depthIntrinsics.ppy) / depthIntrinsics.fy;
+      size_t i = (size_t)v * depthWidth + u;
+      rayX[i] = R[0] * x + R[3] * y + R[6];
+      rayY[i] = R[1] * x + R[4] * y + R[7];
+      rayZ[i] = R[2] * x + R[5] * y + R[8];
+    }
+  }
+
+  registeredData = std::make_shared<std::vector<uint16_t>>((size_t)colorWidth * colorHeight, 0);
+  initialized    = true;
+}
+
+bool DepthRegistration::isInitialized()
+{
+  return(initialized);
+}
+
+// Projection pass over one depth row: no branches nor gathers, so the loop
+// is vectorized by the compiler. Coordinates are clamped before the integer
+// conversion so that invalid points (zero depth, behind the camera) stay
+// well defined and are then masked out.
+void DepthRegistration::project(const uint16_t * __restrict__ depth, int32_t * __restrict__ out, int row)
+{
+  const size_t base = (size_t)row * depthWidth;
+  const float * __restrict__ rx = rayX.data() + base;
+  const float * __restrict__ ry = rayY.data() + base;
+  const float * __restrict__ rz = rayZ.data() + base;
+  const float k1 = coeffs[0], k2 = coeffs[1], p1 = coeffs[2], p2 = coeffs[3], k3 = coeffs[4];
+  const float d = distorted ? 1.0f : 0.0f;
+  const float scale = depthScale, _tx = tx, _ty = ty, _tz = tz;
+  const float _fx = fx, _fy = fy, _ppx = ppx, _ppy = ppy;
+  const float maxU = (float)colorWidth, maxV = (float)colorHeight;
+  const int width = depthWidth, cw = colorWidth;
+
+  for (int u = 0; u < width; u++)
+  {
+    float z  = depth[u] * scale;
+    float px = z * rx[u] + _tx;
+    float py = z * ry[u] + _ty;
+    float pz = z * rz[u] + _tz;
+    float iz = 1.0f / std::max(pz, 1e-6f);
+    float x  = px * iz;
+    float y  = py * iz;
+
+    // Modified Brown-Conrady distortion, disabled by d = 0
+    float r2 = x * x + y * y;
+    float f  = 1.0f + d * (k1 * r2 + k2 * r2 * r2 + k3 * r2 * r2 * r2);
+    float xd = x * f;
+    float yd = y * f;
+    float dx = xd + d * (2.0f * p1 * xd * yd + p2 * (r2 + 2.0f * xd * xd));
+    float dy = yd + d * (2.0f * p2 * xd * yd + p1 * (r2 + 2.0f * yd * yd));
+
+    float fu = std::min(std::max(dx * _fx + _ppx + 0.5f, -1.0f), maxU);
+    float fv = std::min(std::max(dy * _fy + _ppy + 0.5f, -1.0f), maxV);
+    int cu = (int)fu;
+    int cv = (int)fv;
+    int valid = (z > 0.0f) & (pz > 0.0f) & (fu >= 0.0f) & (cu < cw) & (fv >= 0.0f) & (cv < (int)maxV);
+    out[u] = valid ? cv * cw + cu : -1;
+  }
+}
+
+cv::Mat DepthRegistration::process(const cv::Mat & depth)
+{
+  if (!initialized || depth.empty() || depth.cols != depthWidth || depth.rows != depthHeight)
+    return(cv::Mat());
+
+  if (registeredData.use_count() > 1)
+    registeredData = std::make_shared<std::vector<uint16_t>>(registeredData->size(), 0);
+  else
+    memset(registeredData->data(), 0, registeredData->size() * sizeof(uint16_t));
+  uint16_t * __restrict__ reg = registeredData->data();
+
+  for (int v = 0; v < depthHeight; v++)
+  {
+    const uint16_t * row = depth.ptr<uint16_t>(v);
+    int32_t * t = target.data() + (size_t)v * depthWidth;
+    project(row, t, v);
+
+    // Scatter keeping the closest surface
+    for (int u = 0; u < depthWidth; u++)
+    {
+      if (t[u] < 0)
+        continue;
+      uint16_t & o = reg[t[u]];
+      if (o == 0 || row[u] < o)
+        o = row[u];
+    }
+  }
+
+  return(cv::Mat(colorHeight, colorWidth, CV_16UC1, reg));
+}
+
+std::shared_ptr<const void> DepthRegistration::getBuffer()
+{
+  return(registeredData);
+}
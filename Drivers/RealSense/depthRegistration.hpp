@@ -0,0 +1,62 @@
+#ifndef __DEPTHREGISTRATION__
+#define __DEPTHREGISTRATION__
+
+#include <vector>
+#include <memory>
+#include <librealsense2/rs.hpp>
+#include <opencv2/opencv.hpp>
+
+// Depth to color registration with precomputed projection tables.
+// The deprojected ray of every depth pixel, already rotated into the color
+// camera frame, is computed once from the stream intrinsics/extrinsics.
+// Each frame then costs one branch-free pass (scale, translate, project),
+// laid out as plain float arrays so that the compiler vectorizes it, plus
+// a scatter pass keeping the closest depth per color pixel.
+// Depth is assumed undistorted (as D4xx depth streams are); the color
+// projection supports the modified Brown-Conrady model.
+class DepthRegistration
+{
+private:
+  int depthWidth, depthHeight;
+  int colorWidth, colorHeight;
+  float depthScale;
+
+  // Color intrinsics
+  float fx, fy, ppx, ppy;
+  float coeffs[5];
+  bool distorted;
+
+  // Depth to color translation [m]
+  float tx, ty, tz;
+
+  // Rotated rays (depth pixel at unit depth, in the color frame)
+  std::vector<float> rayX, rayY, rayZ;
+
+  // Target color pixel of each depth pixel (-1 if not visible)
+  std::vector<int32_t> target;
+
+  // Registered depth buffer (color geometry, Z16). A new buffer is allocated
+  // only while the previous one is still referenced by a frame handle.
+  std::shared_ptr<std::vector<uint16_t>> registeredData;
+
+  bool initialized;
+
+public:
+  // Constructor
+  DepthRegistration();
+
+  // Builds the tables
+  void initialize(const rs2_intrinsics &, const rs2_intrinsics &, const rs2_extrinsics &, float);
+
+  bool isInitialized();
+
+  // Registers a Z16 depth image into the color camera geometry. The returned
+  // matrix lives in the buffer returned by getBuffer().
+  cv::Mat process(const cv::Mat &);
+  std::shared_ptr<const void> getBuffer();
+
+private:
+  void project(const uint16_t *, int32_t *, int);
+};
+
+#endif // __DEPTHREGISTRATION__
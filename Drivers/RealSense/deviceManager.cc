@@ -0,0 +1,183 @@
+#include "deviceManager.hpp"
+#include "exposureMonitor.hpp"
+
+#include <thread>
+#include <iostream>
+
+// Constructor
+DeviceManager::DeviceManager()
+{}
+
+// Destructor
+DeviceManager::~DeviceManager()
+{
+  stopAll();
+}
+
+// Captures serial numbers and names before opening any stream
+size_t DeviceManager::enumerate()
+{
+  stopAll();
+  devices.clear();
+
+  for (auto&& dev : ctx.query_devices())
+  {
+    std::unique_ptr<Device> d(new Device());
+    d->serial   = dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER);
+    d->name     = dev.get_info(RS2_CAMERA_INFO_NAME);
+    d->role     = classify(dev);
+    d->device   = dev;
+    d->pipeline = rs2::pipeline(ctx);
+    d->queue    = rs2::frame_queue(queue_size, true);
+    d->started  = false;
+    d->config.enable_device(d->serial);
+
+    std::cout << "Found " << d->name << " (" << d->serial << ")" << std::endl;
+    devices.push_back(std::move(d));
+  }
+
+  return(devices.size());
+}
+
+size_t DeviceManager::size()
+{
+  return(devices.size());
+}
+
+size_t DeviceManager::count(deviceRole role)
+{
+  size_t n = 0;
+  for (auto & d : devices)
+    if (d->role == role)
+      n++;
+
+  return(n);
+}
+
+int DeviceManager::find(deviceRole role, size_t n)
+{
+  for (size_t i = 0; i < devices.size(); i++)
+    if (devices[i]->role == role && n-- == 0)
+      return((int)i);
+
+  return(-1);
+}
+
+int DeviceManager::findSerial(const std::string & serial)
+{
+  for (size_t i = 0; i < devices.size(); i++)
+    if (devices[i]->serial == serial)
+      return((int)i);
+
+  return(-1);
+}
+
+DeviceManager::Device & DeviceManager::get(size_t i)
+{
+  return(*devices[i]);
+}
+
+rs2::frame_queue & DeviceManager::getQueue(size_t i)
+{
+  return(devices[i]->queue);
+}
+
+void DeviceManager::setWarmUpFrames(uint32_t frames)
+{
+  warm_up_frames = frames;
+}
+
+// Applies to the devices enumerated afterwards
+void DeviceManager::setQueueSize(unsigned int size)
+{
+  queue_size = size > 0 ? size : 1;
+}
+
+// Starts a device pipeline in callback mode. Depth devices then drop their
+// first framesets to let auto-exposure stabilize.
+bool DeviceManager::start(size_t i)
+{
+  Device & d = *devices[i];
+  if (d.started || d.role == UNKNOWN)
+    return(d.started);
+
+  try {
+    if (d.callback)
+      d.profile = d.pipeline.start(d.config, d.callback);
+    else
+      d.profile = d.pipeline.start(d.config, d.queue);
+  } catch (const rs2::error & e) {
+    std::cerr << "Unable to start " << d.name << " (" << d.serial << "): " << e.what() << std::endl;
+    return(false);
+  }
+  d.started = true;
+
+  if (d.role == DEPTH && !d.callback)
+  {
+    // Drop the first framesets until auto-exposure stabilizes
+    try {
+      ExposureMonitor warmUp(warm_up_frames);
+      while (!warmUp.update(d.queue.wait_for_frame())) {}
+    } catch (const rs2::error & e) {
+      std::cerr << d.name << " (" << d.serial << ") is not streaming: " << e.what() << std::endl;
+    }
+  }
+
+  std::cout << "Intel RealSense " << d.name << " (" << d.serial << ") initialized." << std::endl;
+  return(true);
+}
+
+// Starts every device on its own thread: device start-up (and warm-up) is
+// dominated by USB negotiation and firmware latency, not by the host.
+bool DeviceManager::startAll()
+{
+  std::vector<std::thread> starters;
+  std::unique_ptr<bool[]> ok(new bool[devices.size()]);
+
+  for (size_t i = 0; i < devices.size(); i++)
+    starters.emplace_back([this, i, &ok] { ok[i] = start(i); });
+
+  bool all = true;
+  for (size_t i = 0; i < starters.size(); i++) {
+    starters[i].join();
+    all = all && (ok[i] || devices[i]->role == UNKNOWN);
+  }
+
+  return(all);
+}
+
+bool DeviceManager::restart(size_t i)
+{
+  stop(i);
+  return(start(i));
+}
+
+void DeviceManager::stop(size_t i)
+{
+  Device & d = *devices[i];
+  if (!d.started)
+    return;
+
+  d.pipeline.stop();
+  d.started = false;
+}
+
+void DeviceManager::stopAll()
+{
+  for (size_t i = 0; i < devices.size(); i++)
+    stop(i);
+}
+
+// Tracking cameras are identified by name, depth cameras by their sensors
+DeviceManager::deviceRole DeviceManager::classify(const rs2::device & dev)
+{
+  std::string name(dev.get_info(RS2_CAMERA_INFO_NAME));
+  if (name.find("T265") != std::string::npos)
+    return(TRACKING);
+
+  for (auto&& s : dev.query_sensors())
+    if (s.is<rs2::depth_sensor>())
+      return(DEPTH);
+
+  return(UNKNOWN);
+}
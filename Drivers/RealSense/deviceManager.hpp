@@ -0,0 +1,85 @@
+#ifndef __DEVICEMANAGER__
+#define __DEVICEMANAGER__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <librealsense2/rs.hpp>
+
+// Enumerates every connected RealSense device, classifies it by role and
+// runs one pipeline per device. Pipelines are started in parallel and run
+// in callback mode: librealsense delivers the frames of each device on its
+// own thread, either to a user callback or to the device frame queue, so
+// acquisition never serializes the cameras.
+class DeviceManager
+{
+public:
+  // DEPTH    - depth camera (D4xx)
+  // TRACKING - tracking camera (T265)
+  // UNKNOWN  - anything else, never started
+  enum deviceRole { DEPTH, TRACKING, UNKNOWN };
+
+  struct Device {
+    std::string serial;
+    std::string name;
+    deviceRole role;
+    rs2::device device;
+    rs2::config config;   // enable_device(serial) already applied
+    rs2::pipeline pipeline;
+    rs2::pipeline_profile profile;
+
+    // Frame delivery: the callback if set, the queue otherwise. The queue
+    // keeps only the latest framesets (oldest ones are dropped).
+    std::function<void(const rs2::frame &)> callback;
+    rs2::frame_queue queue;
+
+    bool started;
+  };
+
+private:
+  rs2::context ctx;
+  std::vector<std::unique_ptr<Device>> devices;
+
+  // Maximum number of framesets dropped from each depth device queue at start
+  uint32_t warm_up_frames = 30;
+  unsigned int queue_size = 1;
+
+public:
+  // Constructor
+  DeviceManager();
+
+  // Destructor
+  ~DeviceManager();
+
+  // Queries the connected devices, returns how many were found
+  size_t enumerate();
+
+  size_t size();
+  size_t count(deviceRole);
+
+  // Index of the n-th device with the given role, -1 if none
+  int find(deviceRole, size_t = 0);
+  int findSerial(const std::string &);
+
+  Device & get(size_t);
+  rs2::frame_queue & getQueue(size_t);
+
+  void setWarmUpFrames(uint32_t);
+  void setQueueSize(unsigned int);
+
+  // Starts one device, or all the known-role devices concurrently
+  bool start(size_t);
+  bool startAll();
+
+  // Stops and restarts a device with the same configuration
+  bool restart(size_t);
+
+  void stop(size_t);
+  void stopAll();
+
+private:
+  static deviceRole classify(const rs2::device &);
+};
+
+#endif // __DEVICEMANAGER__
@@ -0,0 +1,63 @@
+#ifndef __EXPOSUREMONITOR__
+#define __EXPOSUREMONITOR__
+
+#include <cmath>
+#include <librealsense2/rs.hpp>
+
+// Camera warm-up: tells when auto-exposure has settled, from the
+// ACTUAL_EXPOSURE metadata of the incoming frames. Exposure is stable once
+// it changed by less than TOLERANCE over STABLE_FRAMES consecutive frames.
+// Frames without exposure metadata fall back to a fixed frame count.
+class ExposureMonitor
+{
+public:
+  static constexpr double TOLERANCE = 0.02;
+  static const unsigned int STABLE_FRAMES = 3;
+  static const unsigned int MIN_FRAMES = 5;
+
+private:
+  unsigned int frames;
+  unsigned int stable;
+  double previous;
+  unsigned int fallback;
+
+public:
+  /* Constructor: fallbackFrames is the warm-up length without metadata
+   */
+  ExposureMonitor(unsigned int fallbackFrames)
+  : frames(0), stable(0), previous(-1.0), fallback(fallbackFrames)
+  {
+  }
+
+  /* update(fs): feeds a warm-up frameset, returns true when done.
+   */
+  bool update(const rs2::frameset & fs)
+  {
+    frames++;
+
+    rs2::frame f = fs.first_or_default(RS2_STREAM_INFRARED);
+    if (!f)
+      f = fs.first_or_default(RS2_STREAM_COLOR);
+    if (!f)
+      f = fs.first_or_default(RS2_STREAM_DEPTH);
+
+    if (!f || !f.supports_frame_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE))
+      return frames >= fallback;
+
+    const double exposure = (double)f.get_frame_metadata(RS2_FRAME_METADATA_ACTUAL_EXPOSURE);
+    if (previous > 0.0 && std::fabs(exposure - previous) <= TOLERANCE * previous)
+      stable++;
+    else
+      stable = 0;
+    previous = exposure;
+
+    return (frames >= MIN_FRAMES && stable >= STABLE_FRAMES) || frames >= fallback;
+  }
+
+  unsigned int getFrames() const
+  {
+    return frames;
+  }
+};
+
+#endif // __EXPOSUREMONITOR__
@@ -0,0 +1,184 @@
+#include "frameRecorder.hpp"
+
+#include <iostream>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+// Constructor
+FrameRecorder::FrameRecorder():
+fd(-1), chunkSize(record::DEFAULT_CHUNK_SIZE), chunkIndex(0), chunk(nullptr), chunkOffset(0), recordCount(0)
+{}
+
+// Destructor
+FrameRecorder::~FrameRecorder()
+{
+  close();
+}
+
+bool FrameRecorder::open(const std::string & _path, size_t _chunkSize)
+{
+  close();
+
+  path      = _path;
+  chunkSize = record::align(std::max(_chunkSize, 2 * record::HEADER_SIZE));
+  fd        = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cerr << "Unable to create recording " << path << ": " << strerror(errno) << std::endl;
+    return(false);
+  }
+
+  recordCount = 0;
+  if (!mapChunk(0)) {
+    ::close(fd);
+    fd = -1;
+    return(false);
+  }
+
+  // The file header is written on close(), records start after it
+  chunkOffset = record::HEADER_SIZE;
+  std::cout << "Recording framesets to " << path << std::endl;
+  return(true);
+}
+
+bool FrameRecorder::write(const RecordFrame & frame)
+{
+  if (fd < 0)
+    return(false);
+
+  size_t size = record::align(sizeof(record::RecordHeader));
+  size += record::align(frame.irLeft.total() * frame.irLeft.elemSize());
+  size += record::align(frame.depth.total() * frame.depth.elemSize());
+  size += record::align(frame.color.total() * frame.color.elemSize());
+
+  if (size > chunkSize - record::HEADER_SIZE) {
+    std::cerr << "Frameset of " << size << " bytes does not fit a recording chunk" << std::endl;
+    return(false);
+  }
+
+  // Records never straddle two chunks
+  if (chunkOffset + size > chunkSize) {
+    if (!mapChunk(chunkIndex + 1))
+      return(false);
+    chunkOffset = 0;
+  }
+
+  uint8_t * base = chunk + chunkOffset;
+  record::RecordHeader * header = reinterpret_cast<record::RecordHeader *>(base);
+  size_t offset = record::align(sizeof(record::RecordHeader));
+
+  writeStream(frame.irLeft, frame.irLeftTimestamp, base, offset, header->irLeft);
+  writeStream(frame.depth, frame.depthTimestamp, base, offset, header->depth);
+  writeStream(frame.color, frame.colorTimestamp, base, offset, header->color);
+  header->pose          = frame.pose;
+  header->poseTimestamp = frame.poseTimestamp;
+  header->size          = size;
+  header->index         = recordCount;
+  header->reserved      = 0;
+  // The magic is written last: a record is valid only once complete
+  header->magic         = record::RECORD_MAGIC;
+
+  chunkOffset += size;
+  recordCount++;
+  return(true);
+}
+
+// Copies a matrix row by row (packed) at offset inside the record
+void FrameRecorder::writeStream(const cv::Mat & mat, rs2_time_t timestamp, uint8_t * base, size_t & offset, record::RecordStream & stream)
+{
+  stream.timestamp = timestamp;
+  stream.offset    = offset;
+
+  if (mat.empty()) {
+    stream.width  = 0;
+    stream.height = 0;
+    stream.stride = 0;
+    stream.type   = 0;
+    stream.size   = 0;
+    return;
+  }
+
+  stream.width  = mat.cols;
+  stream.height = mat.rows;
+  stream.type   = mat.type();
+  stream.stride = mat.cols * mat.elemSize();
+  stream.size   = (uint64_t)stream.stride * stream.height;
+
+  if (mat.isContinuous()) {
+    memcpy(base + offset, mat.ptr(0), stream.size);
+  } else {
+    for (int r = 0; r < mat.rows; r++)
+      memcpy(base + offset + (size_t)r * stream.stride, mat.ptr(r), stream.stride);
+  }
+
+  offset += record::align(stream.size);
+}
+
+// Grows the file to hold chunk idx and maps it in place of the current one
+bool FrameRecorder::mapChunk(uint64_t idx)
+{
+  unmapChunk();
+
+  if (ftruncate(fd, (off_t)((idx + 1) * chunkSize)) != 0) {
+    std::cerr << "Unable to grow recording " << path << ": " << strerror(errno) << std::endl;
+    return(false);
+  }
+
+  void * p = mmap(nullptr, chunkSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, (off_t)(idx * chunkSize));
+  if (p == MAP_FAILED) {
+    std::cerr << "Unable to map recording " << path << ": " << strerror(errno) << std::endl;
+    return(false);
+  }
+
+  chunk      = static_cast<uint8_t *>(p);
+  chunkIndex = idx;
+  return(true);
+}
+
+void FrameRecorder::unmapChunk()
+{
+  if (chunk != nullptr) {
+    munmap(chunk, chunkSize);
+    chunk = nullptr;
+  }
+}
+
+void FrameRecorder::close()
+{
+  if (fd < 0)
+    return;
+
+  unmapChunk();
+
+  record::RecordFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, record::FILE_MAGIC, sizeof(header.magic));
+  header.version     = record::FILE_VERSION;
+  header.chunkSize   = chunkSize;
+  header.recordCount = recordCount;
+  header.dataEnd     = chunkIndex * chunkSize + chunkOffset;
+
+  if (pwrite(fd, &header, sizeof(header), 0) != (ssize_t)sizeof(header))
+    std::cerr << "Unable to write recording header " << path << ": " << strerror(errno) << std::endl;
+
+  // Drop the unused tail of the last chunk
+  if (ftruncate(fd, (off_t)header.dataEnd) != 0)
+    std::cerr << "Unable to trim recording " << path << ": " << strerror(errno) << std::endl;
+
+  ::close(fd);
+  fd = -1;
+  std::cout << "Recorded " << recordCount << " framesets to " << path << std::endl;
+}
+
+bool FrameRecorder::isOpen()
+{
+  return(fd >= 0);
+}
+
+uint64_t FrameRecorder::getRecordCount()
+{
+  return(recordCount);
+}
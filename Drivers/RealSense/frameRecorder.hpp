@@ -0,0 +1,46 @@
+#ifndef __FRAMERECORDER__
+#define __FRAMERECORDER__
+
+#include <string>
+#include "recordFormat.hpp"
+
+// Writes framesets into a chunked, memory-mapped recording file
+// (see recordFormat.hpp). The file grows one chunk at a time and only the
+// chunk being written is mapped.
+class FrameRecorder
+{
+private:
+  int fd;
+  size_t chunkSize;
+  uint64_t chunkIndex;
+  uint8_t * chunk;      // current chunk mapping
+  size_t chunkOffset;   // write position inside the current chunk
+  uint64_t recordCount;
+  std::string path;
+
+public:
+  // Constructor
+  FrameRecorder();
+
+  // Destructor
+  ~FrameRecorder();
+
+  // Creates (or truncates) the recording file
+  bool open(const std::string &, size_t = record::DEFAULT_CHUNK_SIZE);
+
+  // Appends a frameset
+  bool write(const RecordFrame &);
+
+  // Flushes the file header and unmaps the file
+  void close();
+
+  bool isOpen();
+  uint64_t getRecordCount();
+
+private:
+  bool mapChunk(uint64_t);
+  void unmapChunk();
+  void writeStream(const cv::Mat &, rs2_time_t, uint8_t *, size_t &, record::RecordStream &);
+};
+
+#endif // __FRAMERECORDER__
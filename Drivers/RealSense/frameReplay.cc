@@ -0,0 +1,247 @@
+#include "frameReplay.hpp"
+
+#include <iostream>
+#include <thread>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Constructor
+FrameReplay::FrameReplay(const std::string & path, pacingMode _pacing, bool _loop):
+fd(-1), mapping(nullptr), mappingSize(0), pacing(_pacing), loop(_loop), next(0), startTimestamp(-1)
+{
+  if (open(path))
+    std::cout << "Replaying " << records.size() << " framesets from " << path << (pacing == REALTIME ? " (real-time)" : " (as fast as possible)") << std::endl;
+}
+
+// Destructor
+FrameReplay::~FrameReplay()
+{
+  close();
+}
+
+// Maps the recording and indexes its records
+bool FrameReplay::open(const std::string & path)
+{
+  fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Unable to open recording " << path << ": " << strerror(errno) << std::endl;
+    return(false);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < record::HEADER_SIZE) {
+    std::cerr << "Invalid recording " << path << std::endl;
+    close();
+    return(false);
+  }
+
+  // Private writable mapping: consumers writing into the matrices get their
+  // own copy-on-write pages and never touch the file.
+  mappingSize = st.st_size;
+  void * p = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) {
+    std::cerr << "Unable to map recording " << path << ": " << strerror(errno) << std::endl;
+    mapping = nullptr;
+    close();
+    return(false);
+  }
+  mapping = static_cast<uint8_t *>(p);
+  madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+
+  const record::RecordFileHeader * header = reinterpret_cast<const record::RecordFileHeader *>(mapping);
+  if (memcmp(header->magic, record::FILE_MAGIC, sizeof(header->magic)) != 0 || header->version != record::FILE_VERSION || header->chunkSize == 0) {
+    std::cerr << "Unsupported recording format " << path << std::endl;
+    close();
+    return(false);
+  }
+
+  // Walk the chunks: an invalid magic marks the unused tail of a chunk
+  const size_t chunkSize = header->chunkSize;
+  const size_t dataEnd   = std::min<size_t>(header->dataEnd, mappingSize);
+  size_t offset = record::HEADER_SIZE;
+  records.reserve(header->recordCount);
+
+  while (offset + sizeof(record::RecordHeader) <= dataEnd)
+  {
+    const record::RecordHeader * r = reinterpret_cast<const record::RecordHeader *>(mapping + offset);
+    if (r->magic != record::RECORD_MAGIC || r->size == 0) {
+      offset = (offset / chunkSize + 1) * chunkSize;
+      continue;
+    }
+
+    if (offset + r->size > dataEnd)
+      break;
+
+    records.push_back(r);
+    offset += r->size;
+  }
+
+  return(true);
+}
+
+void FrameReplay::close()
+{
+  if (mapping != nullptr) {
+    munmap(mapping, mappingSize);
+    mapping = nullptr;
+  }
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+// Blocks until the next frameset is due
+void FrameReplay::run()
+{
+  while (!tryGetLatest()) {
+    if (isFinished())
+      return;
+    std::this_thread::sleep_for(std::chrono::microseconds(200));
+  }
+}
+
+bool FrameReplay::tryGetLatest()
+{
+  if (isFinished() || !isDue())
+    return(false);
+
+  advance();
+  return(true);
+}
+
+bool FrameReplay::isFinished()
+{
+  return(records.empty() || (!loop && next >= records.size()));
+}
+
+size_t FrameReplay::getFramesetCount()
+{
+  return(records.size());
+}
+
+// In real-time mode a frameset is due when the wall clock time elapsed since
+// the first one matches its recorded timestamp offset.
+bool FrameReplay::isDue()
+{
+  if (pacing == FAST || startTimestamp < 0)
+    return(true);
+
+  const record::RecordHeader * r = records[next % records.size()];
+  double due = r->irLeft.size ? r->irLeft.timestamp : r->poseTimestamp;
+  double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+  return(due - startTimestamp <= elapsed);
+}
+
+void FrameReplay::advance()
+{
+  if (next >= records.size()) {
+    // Looping: restart the pacing reference
+    next = 0;
+    startTimestamp = -1;
+  }
+
+  const record::RecordHeader * r = records[next++];
+  current.irLeft          = streamMatrix(r, r->irLeft);
+  current.depth           = streamMatrix(r, r->depth);
+  current.color           = streamMatrix(r, r->color);
+  current.irLeftTimestamp = r->irLeft.timestamp;
+  current.depthTimestamp  = r->depth.timestamp;
+  current.colorTimestamp  = r->color.timestamp;
+  current.pose            = r->pose;
+  current.poseTimestamp   = r->poseTimestamp;
+
+  PoseSample sample;
+  sample.pose      = r->pose;
+  sample.timestamp = r->poseTimestamp;
+  poseRing.push(sample);
+
+  if (startTimestamp < 0) {
+    startTime      = std::chrono::steady_clock::now();
+    startTimestamp = r->irLeft.size ? r->irLeft.timestamp : r->poseTimestamp;
+  }
+}
+
+// Zero-copy view of a stream inside the mapping
+cv::Mat FrameReplay::streamMatrix(const record::RecordHeader * r, const record::RecordStream & stream)
+{
+  if (stream.size == 0)
+    return(cv::Mat());
+
+  uint8_t * data = const_cast<uint8_t *>(reinterpret_cast<const uint8_t *>(r)) + stream.offset;
+  return(cv::Mat(stream.height, stream.width, stream.type, data, stream.stride));
+}
+
+rs2_time_t FrameReplay::getRGBTimestamp()
+{
+  return(current.colorTimestamp);
+}
+
+rs2_time_t FrameReplay::getDepthTimestamp()
+{
+  return(current.depthTimestamp);
+}
+
+rs2_time_t FrameReplay::getIRLeftTimestamp()
+{
+  return(current.irLeftTimestamp);
+}
+
+rs2_time_t FrameReplay::getPoseTimestamp()
+{
+  return(current.poseTimestamp);
+}
+
+cv::Mat FrameReplay::getColorMatrix()
+{
+  return(current.color);
+}
+
+cv::Mat FrameReplay::getDepthMatrix()
+{
+  return(current.depth);
+}
+
+cv::Mat FrameReplay::getIRLeftMatrix()
+{
+  return(current.irLeft);
+}
+
+FrameHandle FrameReplay::getColorHandle()
+{
+  return(FrameHandle(current.color, nullptr, current.colorTimestamp, next));
+}
+
+FrameHandle FrameReplay::getDepthHandle()
+{
+  return(FrameHandle(current.depth, nullptr, current.depthTimestamp, next));
+}
+
+FrameHandle FrameReplay::getIRLeftHandle()
+{
+  return(FrameHandle(current.irLeft, nullptr, current.irLeftTimestamp, next));
+}
+
+rs2_pose FrameReplay::getPose()
+{
+  return(current.pose);
+}
+
+// Recordings hold one pose per frameset, each one is served once as a pose sample
+bool FrameReplay::popPoseSample(rs2_pose & _pose, rs2_time_t & _timestamp)
+{
+  PoseSample sample;
+  if (!poseRing.pop(sample))
+    return(false);
+
+  _pose      = sample.pose;
+  _timestamp = sample.timestamp;
+  return(true);
+}
+
+void FrameReplay::resetPoseTrack()
+{}
@@ -0,0 +1,89 @@
+#ifndef __FRAMEREPLAY__
+#define __FRAMEREPLAY__
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include "recordFormat.hpp"
+#include "spscRing.hpp"
+#include "frameSource.hpp"
+
+// Replays a recording written by FrameRecorder through the same accessors of
+// the RealSense driver. The whole file is memory-mapped and the returned
+// matrices point straight into the mapping: no frame is ever copied.
+class FrameReplay : public FrameSource
+{
+public:
+  // Pacing of the replay
+  // REALTIME - framesets are served following their recorded timestamps
+  // FAST     - framesets are served as fast as they are requested
+  enum pacingMode { REALTIME, FAST };
+
+private:
+  int fd;
+  uint8_t * mapping;
+  size_t mappingSize;
+  std::vector<const record::RecordHeader *> records;
+  pacingMode pacing;
+  bool loop;
+
+  // Current frameset
+  size_t next;
+  RecordFrame current;
+
+  // Recorded poses, one per frameset, for the pose stream consumer
+  SpscRing<PoseSample, 64> poseRing;
+
+  // Real-time pacing reference
+  std::chrono::steady_clock::time_point startTime;
+  rs2_time_t startTimestamp;
+
+public:
+  // Constructor
+  FrameReplay(const std::string &, pacingMode = REALTIME, bool = false);
+
+  // Destructor
+  ~FrameReplay();
+
+  // Process (blocks until the next frameset is due)
+  void run();
+
+  // Non-blocking: moves to the next frameset if it is due
+  bool tryGetLatest();
+
+  // True when all the framesets have been served (never when looping)
+  bool isFinished();
+  size_t getFramesetCount();
+
+  // Operations with frame timestamps
+  rs2_time_t getRGBTimestamp();
+  rs2_time_t getDepthTimestamp();
+  rs2_time_t getIRLeftTimestamp();
+  rs2_time_t getPoseTimestamp();
+
+  // Get frame matrices
+  cv::Mat getColorMatrix();
+  cv::Mat getDepthMatrix();
+  cv::Mat getIRLeftMatrix();
+
+  // Get frames (backed by the file mapping, no owner needed)
+  FrameHandle getColorHandle();
+  FrameHandle getDepthHandle();
+  FrameHandle getIRLeftHandle();
+
+  // Get pose
+  rs2_pose getPose();
+  bool popPoseSample(rs2_pose &, rs2_time_t &);
+
+  // Reset pose tracking (recorded poses cannot be reset)
+  void resetPoseTrack();
+
+private:
+  bool open(const std::string &);
+  void close();
+  bool isDue();
+  void advance();
+  cv::Mat streamMatrix(const record::RecordHeader *, const record::RecordStream &);
+};
+
+#endif // __FRAMEREPLAY__
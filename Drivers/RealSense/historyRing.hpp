@@ -0,0 +1,132 @@
+#ifndef __HISTORYRING__
+#define __HISTORYRING__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <librealsense2/rs.hpp>
+
+// Lock-free single producer / multiple readers history of timestamped
+// samples. The producer overwrites the oldest slot when the ring is full and
+// never waits; readers copy any range of the last S samples at any time.
+// Each slot is guarded by a sequence number (seqlock): a read that raced
+// with the producer overwriting the slot is detected and reported.
+// T must have a rs2_time_t timestamp member, increasing along the stream.
+// S must be a power of two.
+template <typename T, size_t S>
+class HistoryRing {
+  static_assert(S >= 4 && (S & (S - 1)) == 0, "HistoryRing size must be a power of two");
+
+public:
+
+  /* Constructor
+   */
+  HistoryRing()
+  : m_head(0)
+  {
+    for (size_t i = 0; i < S; i++)
+      m_seq[i].store(0, std::memory_order_relaxed);
+  }
+
+  /* push(v): producer side, appends v overwriting the oldest sample.
+   */
+  void push(const T & v)
+  {
+    const uint64_t head = m_head.load(std::memory_order_relaxed);
+    const size_t slot = head & MASK;
+
+    m_seq[slot].store(2 * head + 1, std::memory_order_relaxed); // odd: being written
+    std::atomic_thread_fence(std::memory_order_release);
+    m_buf[slot] = v;
+    m_seq[slot].store(2 * head + 2, std::memory_order_release);
+    m_head.store(head + 1, std::memory_order_release);
+  }
+
+  /* count(): number of samples pushed since the beginning.
+   */
+  uint64_t count() const
+  {
+    return m_head.load(std::memory_order_acquire);
+  }
+
+  /* get(i, v): reads the i-th sample ever pushed. Returns false if it was not
+   * pushed yet or was already overwritten.
+   */
+  bool get(uint64_t i, T & v) const
+  {
+    const size_t slot = i & MASK;
+    if (m_seq[slot].load(std::memory_order_acquire) != 2 * i + 2)
+      return false;
+
+    v = m_buf[slot];
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_seq[slot].load(std::memory_order_relaxed) == 2 * i + 2;
+  }
+
+  /* latest(v): reads the newest sample, false if none.
+   */
+  bool latest(T & v) const
+  {
+    const uint64_t head = count();
+    return head > 0 && get(head - 1, v);
+  }
+
+  /* copyRange(t0, t1, out): copies the samples covering [t0, t1], i.e. from
+   * the last one at or before t0 to the first one at or after t1. Returns
+   * false if the history does not cover the interval.
+   */
+  bool copyRange(rs2_time_t t0, rs2_time_t t1, std::vector<T> & out) const
+  {
+    out.clear();
+    const uint64_t head = count();
+    if (head == 0)
+      return false;
+
+    // Leave a margin to the slots the producer is about to overwrite
+    uint64_t lo = head > S - MARGIN ? head - (S - MARGIN) : 0;
+    uint64_t hi = head - 1;
+
+    T v;
+    if (!get(lo, v) || v.timestamp > t0)
+      return false;
+    if (!get(hi, v) || v.timestamp < t1)
+      return false;
+
+    // Last sample at or before t0
+    uint64_t a = lo, b = hi;
+    while (b - a > 1) {
+      const uint64_t m = a + (b - a) / 2;
+      if (!get(m, v))
+        return false;
+      if (v.timestamp <= t0)
+        a = m;
+      else
+        b = m;
+    }
+
+    for (uint64_t i = a; i <= hi; i++) {
+      if (!get(i, v))
+        return false;
+      out.push_back(v);
+      if (v.timestamp >= t1)
+        break;
+    }
+
+    return true;
+  }
+
+private:
+
+  static const size_t MASK = S - 1;
+  static const size_t MARGIN = S / 8;
+
+  T m_buf[S];
+  std::atomic<uint64_t> m_seq[S];
+  std::atomic<uint64_t> m_head;
+
+  HistoryRing(const HistoryRing &) = delete;
+  HistoryRing & operator=(const HistoryRing &) = delete;
+};
+
+#endif // __HISTORYRING__
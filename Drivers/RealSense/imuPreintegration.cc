@@ -0,0 +1,112 @@
+#include "imuPreintegration.hpp"
+
+#include <cmath>
+
+// Minimal quaternion algebra (w, x, y, z), in double precision
+struct Quat {
+  double w, x, y, z;
+};
+
+static inline Quat multiply(const Quat & a, const Quat & b)
+{
+  Quat q;
+  q.w = a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z;
+  q.x = a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y;
+  q.y = a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x;
+  q.z = a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w;
+  return(q);
+}
+
+// Rotation of angle |v| around v
+static inline Quat expmap(double vx, double vy, double vz)
+{
+  const double angle = std::sqrt(vx*vx + vy*vy + vz*vz);
+  Quat q;
+  if (angle < 1e-12) {
+    q.w = 1.0; q.x = 0.5*vx; q.y = 0.5*vy; q.z = 0.5*vz;
+  } else {
+    const double s = std::sin(0.5*angle) / angle;
+    q.w = std::cos(0.5*angle); q.x = s*vx; q.y = s*vy; q.z = s*vz;
+  }
+  return(q);
+}
+
+// v' = q v q*
+static inline void rotate(const Quat & q, const double v[3], double out[3])
+{
+  const double tx = 2.0 * (q.y*v[2] - q.z*v[1]);
+  const double ty = 2.0 * (q.z*v[0] - q.x*v[2]);
+  const double tz = 2.0 * (q.x*v[1] - q.y*v[0]);
+  out[0] = v[0] + q.w*tx + (q.y*tz - q.z*ty);
+  out[1] = v[1] + q.w*ty + (q.z*tx - q.x*tz);
+  out[2] = v[2] + q.w*tz + (q.x*ty - q.y*tx);
+}
+
+// Linear interpolation of the samples at t. The hint is the segment used at
+// the previous call, since queries are made at increasing times.
+static void interpolate(const std::vector<MotionSample> & s, rs2_time_t t, size_t & hint, double out[3])
+{
+  while (hint + 2 < s.size() && s[hint + 1].timestamp < t)
+    hint++;
+
+  const MotionSample & a = s[hint];
+  const MotionSample & b = s[hint + 1 < s.size() ? hint + 1 : hint];
+  const double span = b.timestamp - a.timestamp;
+  double k = span > 0.0 ? (t - a.timestamp) / span : 0.0;
+  k = k < 0.0 ? 0.0 : (k > 1.0 ? 1.0 : k);
+
+  out[0] = a.value.x + k * (b.value.x - a.value.x);
+  out[1] = a.value.y + k * (b.value.y - a.value.y);
+  out[2] = a.value.z + k * (b.value.z - a.value.z);
+}
+
+bool imuPreintegrate(const std::vector<MotionSample> & gyro, const std::vector<MotionSample> & accel, rs2_time_t t0, rs2_time_t t1, FrameSource::ImuDelta & delta)
+{
+  if (gyro.empty() || accel.empty() || t1 < t0)
+    return(false);
+
+  Quat R = { 1.0, 0.0, 0.0, 0.0 };
+  double v[3] = { 0.0, 0.0, 0.0 };
+  size_t gHint = 0, aHint = 0;
+  unsigned int steps = 0;
+
+  rs2_time_t ta = t0;
+  size_t next = 0;
+  while (ta < t1)
+  {
+    // Step to the next gyro sample (or to t1)
+    while (next < gyro.size() && gyro[next].timestamp <= ta)
+      next++;
+    const rs2_time_t tb = (next < gyro.size() && gyro[next].timestamp < t1) ? gyro[next].timestamp : t1;
+    const double dt = (tb - ta) * 1e-3; // [s]
+    const rs2_time_t tm = 0.5 * (ta + tb);
+
+    double w[3], a[3], aw[3];
+    interpolate(gyro, tm, gHint, w);
+    interpolate(accel, tm, aHint, a);
+
+    // Midpoint rotation for the velocity update
+    const Quat Rm = multiply(R, expmap(0.5*w[0]*dt, 0.5*w[1]*dt, 0.5*w[2]*dt));
+    rotate(Rm, a, aw);
+    v[0] += aw[0] * dt;
+    v[1] += aw[1] * dt;
+    v[2] += aw[2] * dt;
+
+    R = multiply(R, expmap(w[0]*dt, w[1]*dt, w[2]*dt));
+    ta = tb;
+    steps++;
+  }
+
+  const double n = std::sqrt(R.w*R.w + R.x*R.x + R.y*R.y + R.z*R.z);
+  delta.rotation.w = (float)(R.w / n);
+  delta.rotation.x = (float)(R.x / n);
+  delta.rotation.y = (float)(R.y / n);
+  delta.rotation.z = (float)(R.z / n);
+  delta.velocity.x = (float)v[0];
+  delta.velocity.y = (float)v[1];
+  delta.velocity.z = (float)v[2];
+  delta.dt         = t1 - t0;
+  delta.samples    = steps;
+
+  return(true);
+}
@@ -0,0 +1,21 @@
+#ifndef __IMUPREINTEGRATION__
+#define __IMUPREINTEGRATION__
+
+#include <vector>
+#include <librealsense2/rs.hpp>
+#include "frameSource.hpp"
+
+// Single IMU measurement (gyro [rad/s] or accel [m/s^2]) with its timestamp
+struct MotionSample {
+  rs2_time_t timestamp; // [ms]
+  rs2_vector value;
+};
+
+// Integrates gyro and accel samples between t0 and t1 [ms]. Both sample
+// lists must cover the interval (see HistoryRing::copyRange()). The interval
+// is split at every gyro sample; on each step the angular rate and the
+// specific force are linearly interpolated at the midpoint, the velocity
+// change is accumulated in the t0 frame, then the rotation is advanced.
+bool imuPreintegrate(const std::vector<MotionSample> &, const std::vector<MotionSample> &, rs2_time_t, rs2_time_t, FrameSource::ImuDelta &);
+
+#endif // __IMUPREINTEGRATION__
@@ -1,19 +1,79 @@
 #include "realsense.hpp"
 
+// Rigid transform algebra on T265 poses. Linear and angular velocities and
+// accelerations are expressed in the pose reference frame, so they are only
+// rotated when the reference frame changes.
+static inline rs2_quaternion qmul(const rs2_quaternion & a, const rs2_quaternion & b)
+{
+  rs2_quaternion q;
+  q.w = a.w*b.w - a.x*b.x - a.y*b.y - a.z*b.z;
+  q.x = a.w*b.x + a.x*b.w + a.y*b.z - a.z*b.y;
+  q.y = a.w*b.y - a.x*b.z + a.y*b.w + a.z*b.x;
+  q.z = a.w*b.z + a.x*b.y - a.y*b.x + a.z*b.w;
+  return(q);
+}
+
+static inline rs2_quaternion qconj(const rs2_quaternion & q)
+{
+  rs2_quaternion c = { -q.x, -q.y, -q.z, q.w };
+  return(c);
+}
+
+static inline rs2_vector qrot(const rs2_quaternion & q, const rs2_vector & v)
+{
+  const float tx = 2.0f * (q.y*v.z - q.z*v.y);
+  const float ty = 2.0f * (q.z*v.x - q.x*v.z);
+  const float tz = 2.0f * (q.x*v.y - q.y*v.x);
+  rs2_vector r = { v.x + q.w*tx + (q.y*tz - q.z*ty),
+                   v.y + q.w*ty + (q.z*tx - q.x*tz),
+                   v.z + q.w*tz + (q.x*ty - q.y*tx) };
+  return(r);
+}
+
+// a * b
+static rs2_pose composePose(const rs2_pose & a, const rs2_pose & b)
+{
+  rs2_pose r = b;
+  rs2_vector t = qrot(a.rotation, b.translation);
+  r.translation.x = a.translation.x + t.x;
+  r.translation.y = a.translation.y + t.y;
+  r.translation.z = a.translation.z + t.z;
+  r.rotation = qmul(a.rotation, b.rotation);
+  r.velocity             = qrot(a.rotation, b.velocity);
+  r.acceleration         = qrot(a.rotation, b.acceleration);
+  r.angular_velocity     = qrot(a.rotation, b.angular_velocity);
+  r.angular_acceleration = qrot(a.rotation, b.angular_acceleration);
+  return(r);
+}
+
+// a^-1 (rigid part only)
+static rs2_pose inversePose(const rs2_pose & a)
+{
+  rs2_pose r = a;
+  r.rotation = qconj(a.rotation);
+  rs2_vector t = qrot(r.rotation, a.translation);
+  r.translation.x = -t.x;
+  r.translation.y = -t.y;
+  r.translation.z = -t.z;
+  return(r);
+}
+
+static rs2_pose identityPose()
+{
+  rs2_pose p = rs2_pose();
+  p.rotation.w = 1.0f;
+  return(p);
+}
+
 // Constructor
 RealSense::RealSense(const sModality modality):
 sensorModality(modality), color_fps(30), ir_left_fps(30), ir_right_fps(30), depth_fps(30)
 {
   if (modality == RGBD || modality == IRD || modality == IRL || modality == IRR) {
-    rs2::config _config;
-    config.reserve(1);
-    config[D435I] = _config;
+    config.resize(1);
     initialize(MIN_DELTA_TIMEFRAMES_THRESHOLD);
   }
   else if (modality == MULTI) {
-    rs2::config _config, _config2;
-    config.push_back(_config);
-    config.push_back(_config2);
     initializeMulti(MIN_DELTA_TIMEFRAMES_THRESHOLD);
   }
 }
@@ -23,6 +83,7 @@ sensorModality(modality), color_fps(30), ir_left_fps(30), ir_right_fps(30), dept
 RealSense::RealSense(const sModality modality, double maximumDeltaTimeframes):
 sensorModality(modality), color_fps(30), ir_left_fps(30), ir_right_fps(30), depth_fps(30)
 {
+  config.resize(1);
   if (maximumDeltaTimeframes > MIN_DELTA_TIMEFRAMES_THRESHOLD)
     initialize(maximumDeltaTimeframes);
   else
@@ -36,6 +97,7 @@ sensorModality(modality), color_fps(30), ir_left_fps(30), ir_right_fps(30), dept
 RealSense::RealSense(const sModality modality, uint32_t fps):
 sensorModality(modality), color_fps(fps), ir_left_fps(fps), ir_right_fps(fps), depth_fps(fps)
 {
+  config.resize(1);
   initialize(MIN_DELTA_TIMEFRAMES_THRESHOLD);
 }
 
@@ -48,37 +110,252 @@ RealSense::~RealSense()
 // Public function for processing and updating sensor
 void RealSense::run()
 {
-  switch (sensorModality)
+  if (capturing.load(std::memory_order_acquire)) {
+    // Frames are acquired by the capture threads: wait for a fresh one
+    while (!tryGetLatest())
+      std::this_thread::sleep_for(std::chrono::microseconds(capture_poll_us));
+    return;
+  }
+
+  updateFrame();
+  if (postProcessor.isEnabled())
+    postProcess();
+  updateStreams();
+}
+
+// Starts one capture thread per depth camera. From now on the pipelines are
+// only read by the capture threads, which publish their latest frameset.
+void RealSense::startCapture()
+{
+  if (capturing.exchange(true))
+    return;
+
+  // The T265 is already callback driven (see poseCallback())
+  if (sensorModality != MULTI) {
+    captureThreads.emplace_back(&RealSense::captureLoop, this, pipeline, D435I);
+  } else {
+    for (size_t k = 0; k < depthDevices.size(); k++)
+      captureThreads.emplace_back(&RealSense::queueLoop, this, devices.getQueue(depthDevices[k]), k);
+  }
+
+  if (postProcessor.isEnabled())
+    startProcessing();
+}
+
+void RealSense::stopCapture()
+{
+  if (!capturing.exchange(false))
+    return;
+
+  for (auto & t : captureThreads)
+    t.join();
+  captureThreads.clear();
+
+  stopProcessing();
+}
+
+// Non-blocking update: consumes the most recent frameset published by the
+// capture threads. Returns false if nothing new arrived since the last call.
+// In MULTI modality a new D435i frameset is required, while the T265 pose is
+// just refreshed to the latest one received.
+bool RealSense::tryGetLatest()
+{
+  if (latestFramesets.empty())
+    return(false);
+
+  if (processing.load(std::memory_order_acquire)) {
+    if (!processedFramesets.update())
+      return(false);
+
+    frameset          = processedFramesets.read().frameset;
+    processed_ir_left = processedFramesets.read().irLeft;
+  } else {
+    if (!latestFramesets[D435I]->update())
+      return(false);
+
+    frameset = latestFramesets[D435I]->read();
+  }
+
+  updateStreams();
+  return(true);
+}
+
+// Capture thread: waits on a single pipeline and publishes every frameset
+void RealSense::captureLoop(rs2::pipeline pipe, unsigned int channel)
+{
+  rs2::frameset fs;
+  while (capturing.load(std::memory_order_acquire))
   {
-    case RGBD:
-      updateRGBD();
-      break;
-    case IRD:
-      updateIRD();
-      break;
-    case IRL:
-      updateIRL();
-      break;
-    case IRR:
-      updateIRR();
-      break;
-    case MULTI:
-      updateMULTI();
-      break;
-    default:
-      break;
+    try {
+      if (pipe.try_wait_for_frames(&fs, capture_timeout_ms)) {
+        observeFrameset(fs, channel);
+        publishFrameset(fs, channel);
+      }
+    } catch (const rs2::error & e) {
+      // The pipeline is being stopped or restarted (e.g. pose track reset)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+}
+
+// Hands a frameset over to the consumer. The depth frameset is published
+// under processMutex, so the worker cannot miss it between the check of its
+// wait predicate and the wait.
+void RealSense::publishFrameset(const rs2::frameset & fs, unsigned int channel)
+{
+  if (channel != D435I) {
+    latestFramesets[channel]->publish(fs);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(processMutex);
+    latestFramesets[channel]->publish(fs);
   }
+  processCv.notify_one();
 }
 
+// Capture thread for a device started in callback mode: librealsense fills
+// the device queue, this thread only moves the framesets to the consumer.
+void RealSense::queueLoop(rs2::frame_queue queue, unsigned int channel)
+{
+  rs2::frameset fs;
+  while (capturing.load(std::memory_order_acquire))
+  {
+    if (queue.try_wait_for_frame(&fs, capture_timeout_ms)) {
+      observeFrameset(fs, channel);
+      publishFrameset(fs, channel);
+    }
+  }
+}
+
+// Feeds the clock model of a capture channel with a frameset arrival. All
+// the streams of a device share its clock, any frame of the set will do.
+void RealSense::observeFrameset(const rs2::frameset & fs, unsigned int channel)
+{
+  rs2::frame f = fs.first_or_default(RS2_STREAM_DEPTH);
+  if (!f)
+    f = fs.first_or_default(RS2_STREAM_INFRARED);
+  if (!f)
+    f = fs.first_or_default(RS2_STREAM_COLOR);
+
+  if (f)
+    depthClocks[channel]->update(f);
+}
+
+// Moves a frame handle timestamp to the common (host monotonic) domain
+void RealSense::mapTimestamp(FrameHandle & handle)
+{
+  if (!handle.empty())
+    handle.timestamp = depthClocks[D435I]->toCommon(handle.timestamp, handle.domain);
+}
+
+size_t RealSense::getDepthDeviceCount()
+{
+  return(latestFramesets.size());
+}
+
+// Latest frameset of a secondary depth camera, false if none is new
+bool RealSense::tryGetLatestFrameset(size_t channel, rs2::frameset & fs)
+{
+  if (channel == D435I || channel >= latestFramesets.size())
+    return(false);
+
+  if (!latestFramesets[channel]->update())
+    return(false);
+
+  fs = latestFramesets[channel]->read();
+  return(true);
+}
+
+DeviceManager & RealSense::getDeviceManager()
+{
+  return(devices);
+}
+
+// Configures the depth post-processing chain. While capturing, the worker
+// thread is restarted so that the filters are never changed under it.
+bool RealSense::setDepthPostProcessing(const DepthFilterConfig & filterConfig)
+{
+  DepthFilterConfig cfg = filterConfig;
+
+  // The registration tables are built for the full depth resolution
+  if (sensorModality == RGBD && alignMode == ALIGN_TABLES && cfg.decimation > 1) {
+    std::cerr << "Depth decimation is not supported with table alignment. Disabled." << std::endl;
+    cfg.decimation = 1;
+  }
+
+  if (cfg.decimation > 1)
+    std::cerr << "Depth decimation " << cfg.decimation << ": IR and depth images are downsampled, camera settings must be scaled accordingly." << std::endl;
+
+  stopProcessing();
+  postProcessor.configure(cfg);
+  processed_ir_left.reset();
+
+  if (capturing.load(std::memory_order_acquire) && postProcessor.isEnabled())
+    startProcessing();
+
+  return(true);
+}
+
+void RealSense::startProcessing()
+{
+  if (processing.exchange(true))
+    return;
+
+  processingThread = std::thread(&RealSense::processingLoop, this);
+}
+
+void RealSense::stopProcessing()
+{
+  {
+    std::lock_guard<std::mutex> lock(processMutex);
+    if (!processing.exchange(false))
+      return;
+  }
+
+  processCv.notify_one();
+  processingThread.join();
+}
+
+// Worker thread: filters every frameset published by the capture thread.
+// Filtering the frameset N overlaps with the tracking of frameset N-1.
+void RealSense::processingLoop()
+{
+  while (processing.load(std::memory_order_acquire))
+  {
+    {
+      std::unique_lock<std::mutex> lock(processMutex);
+      processCv.wait_for(lock, std::chrono::milliseconds(capture_timeout_ms), [this] {
+        return(latestFramesets[D435I]->hasUpdate() || !processing.load(std::memory_order_relaxed));
+      });
+    }
+
+    if (!latestFramesets[D435I]->update())
+      continue;
+
+    ProcessedFrameset out;
+    out.frameset = postProcessor.process(latestFramesets[D435I]->read());
+    if (sensorModality == IRD || sensorModality == MULTI)
+      out.irLeft = postProcessor.matchDepth(out.frameset.get_infrared_frame(IR_LEFT), out.frameset.get_depth_frame());
+
+    processedFramesets.publish(out);
+  }
+}
+
+// Synchronous post-processing of the current frameset (no capture threads)
+void RealSense::postProcess()
+{
+  frameset = postProcessor.process(frameset);
+  if (sensorModality == IRD || sensorModality == MULTI)
+    processed_ir_left = postProcessor.matchDepth(frameset.get_infrared_frame(IR_LEFT), frameset.get_depth_frame());
+}
+
+// Timestamps are cached in the frame handles once per frameset
 rs2_time_t RealSense::getRGBTimestamp()
 {
   if (sensorModality == RGBD) {
-    // Get each frame
-    rs2::frame cFrame  = aligned_frameset.get_color_frame();
-    rs2_frame * frameP = cFrame.get();
-
-    // Get frame timestamp
-    return(rs2_get_frame_timestamp(frameP, &e));
+    return(color_handle.timestamp);
   } else {
     return(-1);
   }
@@ -86,35 +363,23 @@ rs2_time_t RealSense::getRGBTimestamp()
 
 rs2_time_t RealSense::getDepthTimestamp()
 {
-  rs2::frame cFrame;
   switch (sensorModality)
   {
     case RGBD:
-      cFrame  = aligned_frameset.get_depth_frame();
-      break;
     case IRD:
-      cFrame  = frameset.get_depth_frame();
-      break;
+      return(depth_handle.timestamp);
     default:
       std::cerr << "NOT IMPLEMENTED" << std::endl;
       break;
   }
 
-  rs2_frame * frameP = cFrame.get();
-
-  // Get frame timestamp
-  return(rs2_get_frame_timestamp(frameP, &e));
+  return(-1);
 }
 
 rs2_time_t RealSense::getIRLeftTimestamp()
 {
   if ((sensorModality == IRD) || (sensorModality == IRL) || (sensorModality == MULTI)) {
-    // Get each frame
-    rs2::frame cFrame  = frameset.get_infrared_frame(IR_LEFT);
-    rs2_frame * frameP = cFrame.get();
-
-    // Get frame timestamp
-    return(rs2_get_frame_timestamp(frameP, &e));
+    return(ir_left_handle.timestamp);
   } else {
     return(-1);
   }
@@ -123,12 +388,7 @@ rs2_time_t RealSense::getIRLeftTimestamp()
 rs2_time_t RealSense::getPoseTimestamp()
 {
   if (sensorModality == MULTI) {
-    // Get each frame
-    auto cFrame = frameset2.get_pose_frame();
-    rs2_frame * frameP = cFrame.get();
-
-    // Get frame timestamp
-    return(rs2_get_frame_timestamp(frameP, &e));
+    return(pose_timestamp);
   } else {
     return(-1);
   }
@@ -187,41 +447,102 @@ bool RealSense::isValidAlignedFrame()
 // Get color matrix
 cv::Mat RealSense::getColorMatrix()
 {
-  cv::Mat color(cv::Size(color_width, color_height), CV_8UC3, (void*)color_frame.get_data(), cv::Mat::AUTO_STEP);
-  return(color);
+  return(color_handle.view);
 }
 
 // Get depth matrix
 cv::Mat RealSense::getDepthMatrix()
 {
-  cv::Mat depth(cv::Size(depth_width, depth_height), CV_16UC1, (void*)depth_frame.get_data(), cv::Mat::AUTO_STEP);
-  return(depth);
+  return(depth_handle.view);
 }
 
 // Get IR left matrix
 cv::Mat RealSense::getIRLeftMatrix()
 {
-  cv::Mat ir_left(cv::Size(ir_left_width, ir_left_height), CV_8UC1, (void*)ir_left_frame.get_data(), cv::Mat::AUTO_STEP);
-  return(ir_left);
+  return(ir_left_handle.view);
 }
 
 // Get IR right matrix
 cv::Mat RealSense::getIRRightMatrix()
 {
-  cv::Mat ir_right(cv::Size(ir_right_width, ir_right_height), CV_8UC1, (void*)ir_right_frame.get_data(), cv::Mat::AUTO_STEP);
-  return(ir_right);
+  return(ir_right_handle.view);
+}
+
+// Get pinned color frame
+FrameHandle RealSense::getColorHandle()
+{
+  return(color_handle);
+}
+
+// Get pinned depth frame
+FrameHandle RealSense::getDepthHandle()
+{
+  return(depth_handle);
+}
+
+// Get pinned IR left frame
+FrameHandle RealSense::getIRLeftHandle()
+{
+  return(ir_left_handle);
 }
 
 rs2_pose RealSense::getPose()
 {
-  rs2_pose tmp = pose;
-  tmp.translation.x = -pose.translation.z;
-  tmp.translation.y = -pose.translation.x;
-  tmp.translation.z = pose.translation.y;
-  tmp.rotation.w    = pose.rotation.w;
-  tmp.rotation.x    = pose.rotation.z;
-  tmp.rotation.y    = -pose.rotation.x;
-  tmp.rotation.z    = pose.rotation.y;
+  return(convertPose(pose));
+}
+
+// Pops the oldest T265 pose sample queued by the pipeline callback.
+// Samples are delivered at the native pose stream rate (200 Hz).
+bool RealSense::popPoseSample(rs2_pose & _pose, rs2_time_t & _timestamp)
+{
+  PoseSample sample;
+  do {
+    if (!poseRing.pop(sample))
+      return(false);
+  } while (sample.timestamp <= originSwitchTs.load(std::memory_order_acquire));
+
+  _pose      = convertPose(sample.pose);
+  _timestamp = sample.timestamp;
+  return(true);
+}
+
+// Conversion from the T265 reference frame. Linear velocity and acceleration
+// follow the translation, angular ones follow the axis of the rotation, so
+// that they stay consistent with the converted pose.
+rs2_pose RealSense::convertPose(const rs2_pose & _pose)
+{
+  rs2_pose tmp = _pose;
+  tmp.translation          = convertLinear(_pose.translation);
+  tmp.velocity             = convertLinear(_pose.velocity);
+  tmp.acceleration         = convertLinear(_pose.acceleration);
+  tmp.rotation.w           = _pose.rotation.w;
+  tmp.rotation.x           = _pose.rotation.z;
+  tmp.rotation.y           = -_pose.rotation.x;
+  tmp.rotation.z           = _pose.rotation.y;
+  tmp.angular_velocity     = convertAngular(_pose.angular_velocity);
+  tmp.angular_acceleration = convertAngular(_pose.angular_acceleration);
+
+  return(tmp);
+}
+
+// Conversion of a T265 vector along the translation axes
+rs2_vector RealSense::convertLinear(const rs2_vector & _v)
+{
+  rs2_vector tmp;
+  tmp.x = -_v.z;
+  tmp.y = -_v.x;
+  tmp.z = _v.y;
+
+  return(tmp);
+}
+
+// Conversion of a T265 vector along the rotation axes
+rs2_vector RealSense::convertAngular(const rs2_vector & _v)
+{
+  rs2_vector tmp;
+  tmp.x = _v.z;
+  tmp.y = -_v.x;
+  tmp.z = _v.y;
 
   return(tmp);
 }
@@ -255,6 +576,8 @@ void RealSense::initialize(rs2_time_t _maxDeltaTimeFrames)
 {
   maxDeltaTimeframes = _maxDeltaTimeFrames;
   cv::setUseOptimized(true);
+  latestFramesets.emplace_back(new TripleBuffer<rs2::frameset>());
+  depthClocks.emplace_back(new ClockDomain());
   initializeSensor();
 }
 
@@ -263,6 +586,7 @@ void RealSense::initializeMulti(rs2_time_t _maxDeltaTimeFrames)
 {
   maxDeltaTimeframes = _maxDeltaTimeFrames;
   cv::setUseOptimized(true);
+  poseOrigin = lastPoseOutput = identityPose();
   initializeSensors();
 }
 
@@ -277,8 +601,6 @@ inline void RealSense::initializeSensor()
       break;
     case IRD:
       config[D435I].enable_stream( rs2_stream::RS2_STREAM_INFRARED, IR_LEFT, ir_left_width, ir_left_height, rs2_format::RS2_FORMAT_Y8, ir_left_fps );
-      // The following is just needed to get the correct baseline information, it will be then disabled.
-      config[D435I].enable_stream( rs2_stream::RS2_STREAM_INFRARED, IR_RIGHT, ir_right_width, ir_right_height, rs2_format::RS2_FORMAT_Y8, ir_right_fps );
       config[D435I].enable_stream( rs2_stream::RS2_STREAM_DEPTH, depth_width, depth_height, rs2_format::RS2_FORMAT_Z16, depth_fps );
       break;
     case IRL:
@@ -296,116 +618,275 @@ inline void RealSense::initializeSensor()
   realSense_device = pipeline_profile.get_device();
 
   // Refer to: https://github.com/raulmur/ORB_SLAM2/issues/259
+  // The baseline comes from the calibration cache (or the stream profiles),
+  // the IR right stream is never started.
   if (sensorModality == IRD)
   {
-    auto depth_sensor = realSense_device.first<rs2::depth_sensor>();
-    auto depth_stream = pipeline_profile.get_stream(RS2_STREAM_DEPTH);
-    auto ir_stream    = pipeline_profile.get_stream(RS2_STREAM_INFRARED, 2);
-
-    const float scale = depth_sensor.get_depth_scale();
-    rs2_intrinsics intrinsics = pipeline_profile.get_stream(RS2_STREAM_INFRARED).as<rs2::video_stream_profile>().get_intrinsics();
-    rs2_extrinsics extrinsics = depth_stream.get_extrinsics_to(ir_stream);
-
-    std::stringstream ss;
-    ss << "    " << std::left << std::setw(31) << "Width"      << ": " << intrinsics.width << std::endl <<
-          "    " << std::left << std::setw(31) << "Height"     << ": " << intrinsics.height << std::endl <<
-          "    " << std::left << std::setw(31) << "Distortion" << ": " << rs2_distortion_to_string(intrinsics.model) << std::endl <<
-          "    " << std::left << std::setw(31) << "Baseline"   << ": " << std::setprecision(15) << extrinsics.translation[0] << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.fx"  << ": " << std::setprecision(15) << intrinsics.fx << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.fy"  << ": " << std::setprecision(15) << intrinsics.fy << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.cx"  << ": " << std::setprecision(15) << intrinsics.ppx << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.cy"  << ": " << std::setprecision(15) << intrinsics.ppy << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.k1"  << ": " << std::setprecision(15) << intrinsics.coeffs[0] << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.k2"  << ": " << std::setprecision(15) << intrinsics.coeffs[1] << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.p1"  << ": " << std::setprecision(15) << intrinsics.coeffs[2] << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.p1"  << ": " << std::setprecision(15) << intrinsics.coeffs[3] << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.k3"  << ": " << std::setprecision(15) << intrinsics.coeffs[4] << std::endl <<
-          "    " << std::left << std::setw(31) << "DepthMapFactor" << ": " << 1/scale << std::endl <<
-          "    " << std::left << std::setw(31) << "Camera.bf"  << ": " << fabs(extrinsics.translation[0]*intrinsics.fx) << std::endl;
-
-    std::cout << ss.str() << std::endl;
-    pipeline.stop();
-    config[D435I].disable_stream(RS2_STREAM_INFRARED, 2);
-    pipeline_profile = pipeline.start(config[D435I]);
-    realSense_device = pipeline_profile.get_device();
+    StereoCalibration calib;
+    if (calibrationCache.get(realSense_device, ir_left_width, ir_left_height, calib))
+      printCalibration(calib);
   }
 
+  if (sensorModality == RGBD)
+    initializeAlignment();
+
+  startImu(realSense_device);
+
   // Disabled by default the laser projector
   disableLaser();
 
-  // Camera warmup - dropping several first frames to let auto-exposure stabilize
-  for (uint32_t i = 0; i < warm_up_frames; i++)
-  {
+  // Camera warmup - dropping the first frames until auto-exposure stabilizes
+  ExposureMonitor warmUp(warm_up_frames);
+  do {
     // Wait for all configured streams to produce a frame
     frameset = pipeline.wait_for_frames();
-  }
+  } while (!warmUp.update(frameset));
 }
 
-// Initialize Sensors for multicamera
-inline void RealSense::initializeSensors()
+// Prints the camera settings ORB-SLAM2 needs for the IRD modality
+void RealSense::printCalibration(const StereoCalibration & calib)
 {
-  rs2::context ctx; // Create librealsense context for managing devices
-  pipelines.reserve(2);
+  const rs2_intrinsics & intrinsics = calib.intrinsics;
+
+  std::stringstream ss;
+  ss << "    " << std::left << std::setw(31) << "Width"      << ": " << intrinsics.width << std::endl <<
+        "    " << std::left << std::setw(31) << "Height"     << ": " << intrinsics.height << std::endl <<
+        "    " << std::left << std::setw(31) << "Distortion" << ": " << rs2_distortion_to_string(intrinsics.model) << std::endl <<
+        "    " << std::left << std::setw(31) << "Baseline"   << ": " << std::setprecision(15) << calib.baseline << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.fx"  << ": " << std::setprecision(15) << intrinsics.fx << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.fy"  << ": " << std::setprecision(15) << intrinsics.fy << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.cx"  << ": " << std::setprecision(15) << intrinsics.ppx << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.cy"  << ": " << std::setprecision(15) << intrinsics.ppy << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.k1"  << ": " << std::setprecision(15) << intrinsics.coeffs[0] << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.k2"  << ": " << std::setprecision(15) << intrinsics.coeffs[1] << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.p1"  << ": " << std::setprecision(15) << intrinsics.coeffs[2] << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.p2"  << ": " << std::setprecision(15) << intrinsics.coeffs[3] << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.k3"  << ": " << std::setprecision(15) << intrinsics.coeffs[4] << std::endl <<
+        "    " << std::left << std::setw(31) << "DepthMapFactor" << ": " << 1/calib.depthScale << std::endl <<
+        "    " << std::left << std::setw(31) << "Camera.bf"  << ": " << fabs(calib.baseline*intrinsics.fx) << std::endl;
+
+  std::cout << ss.str() << std::endl;
+}
 
-  // Capture serial numbers before opening streaming
-  for (auto&& dev : ctx.query_devices())
-  {
-    serials.push_back(dev.get_info(RS2_CAMERA_INFO_SERIAL_NUMBER));
-    names.push_back(dev.get_info(RS2_CAMERA_INFO_NAME));
-  }
+// Builds both alignment methods once for the pipeline life: the
+// rs2::align block and the registration projection tables.
+void RealSense::initializeAlignment()
+{
+  aligner.reset(new rs2::align(rs2_stream::RS2_STREAM_COLOR));
+
+  auto depth_stream = pipeline_profile.get_stream(RS2_STREAM_DEPTH).as<rs2::video_stream_profile>();
+  auto color_stream = pipeline_profile.get_stream(RS2_STREAM_COLOR).as<rs2::video_stream_profile>();
+  const float scale = realSense_device.first<rs2::depth_sensor>().get_depth_scale();
+
+  registration.initialize(depth_stream.get_intrinsics(), color_stream.get_intrinsics(), depth_stream.get_extrinsics_to(color_stream), scale);
+}
 
-  size_t i = 0;
-  // Start a streaming pipe per each connected device
-  for (auto&& serial : serials)
+void RealSense::setAlignMethod(alignMethod method)
+{
+  alignMode = method;
+}
+
+// Initialize Sensors for multicamera: any number of depth cameras plus a
+// tracking camera, all started concurrently by the device manager.
+inline void RealSense::initializeSensors()
+{
+  devices.setWarmUpFrames(warm_up_frames);
+  devices.enumerate();
+
+  for (size_t i = 0; i < devices.size(); i++)
   {
-    rs2::pipeline pipe(ctx);
+    DeviceManager::Device & d = devices.get(i);
 
-    std::string t265("T265");
-    if (names[i].find(t265) != std::string::npos)
+    if (d.role == DeviceManager::TRACKING)
     {
-      config[T265].enable_device(serial);
-      pipe.start(config[T265]);
-      pipelines[T265] = pipe;
-      // Camera warmup - dropping several first frames to let auto-exposure stabilize
-      for (uint32_t i = 0; i < warm_up_frames; i++)
-      {
-        // Wait for all configured streams to produce a frame
-        frameset2 = pipe.wait_for_frames();
+      if (trackingDevice >= 0) {
+        std::cerr << "Tracking camera " << d.serial << " ignored, only one is supported." << std::endl;
+        d.role = DeviceManager::UNKNOWN;
+        continue;
       }
-      std::cout << "Intel RealSense T265 initialized." << std::endl;
+
+      // Every pose frame is pushed into the pose ring as soon as librealsense delivers it
+      d.config.enable_stream(rs2_stream::RS2_STREAM_POSE, rs2_format::RS2_FORMAT_6DOF);
+      d.callback = [this](const rs2::frame & f) { poseCallback(f); };
+      trackingDevice = (int)i;
     }
-    else // should be a D435i
+    else if (d.role == DeviceManager::DEPTH)
     {
-      config[D435I].enable_device(serial);
-      config[D435I].enable_stream( rs2_stream::RS2_STREAM_INFRARED, IR_LEFT, ir_left_width, ir_left_height, rs2_format::RS2_FORMAT_Y8, ir_left_fps );
-      config[D435I].enable_stream( rs2_stream::RS2_STREAM_DEPTH, depth_width, depth_height, rs2_format::RS2_FORMAT_Z16, depth_fps );
-      config[D435I].enable_stream( rs2_stream::RS2_STREAM_COLOR, color_width, color_height, rs2_format::RS2_FORMAT_BGR8, color_fps );
-
-      pipeline_profile = pipe.start(config[D435I]);
-      realSense_device = pipeline_profile.get_device();
-      pipelines[D435I] = pipe;
+      d.config.enable_stream( rs2_stream::RS2_STREAM_INFRARED, IR_LEFT, ir_left_width, ir_left_height, rs2_format::RS2_FORMAT_Y8, ir_left_fps );
+      d.config.enable_stream( rs2_stream::RS2_STREAM_DEPTH, depth_width, depth_height, rs2_format::RS2_FORMAT_Z16, depth_fps );
+      d.config.enable_stream( rs2_stream::RS2_STREAM_COLOR, color_width, color_height, rs2_format::RS2_FORMAT_BGR8, color_fps );
+      depthDevices.push_back((int)i);
+      latestFramesets.emplace_back(new TripleBuffer<rs2::frameset>());
+      depthClocks.emplace_back(new ClockDomain());
 
       // Disabled by default the laser projector
-      disableLaser();
-
-      // Camera warmup - dropping several first frames to let auto-exposure stabilize
-      for (uint32_t i = 0; i < warm_up_frames; i++)
-      {
-        // Wait for all configured streams to produce a frame
-        frameset = pipe.wait_for_frames();
-      }
-      std::cout << "Intel RealSense D435i initialized." << std::endl;
+      auto depth_sensor = d.device.first<rs2::depth_sensor>();
+      if (depth_sensor.supports(RS2_OPTION_LASER_POWER))
+        depth_sensor.set_option(RS2_OPTION_LASER_POWER, 0.f);
     }
+  }
+
+  if (depthDevices.empty())
+    std::cerr << "No depth camera found." << std::endl;
+  if (trackingDevice < 0)
+    std::cerr << "No tracking camera found." << std::endl;
+
+  devices.startAll();
+
+  if (!depthDevices.empty()) {
+    pipeline_profile = devices.get(depthDevices[D435I]).profile;
+    realSense_device = devices.get(depthDevices[D435I]).device;
+    startImu(realSense_device);
+  }
 
-    i++;
+  // Wait for the first pose sample
+  if (trackingDevice >= 0)
+  {
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(pose_wait_ms);
+    while (!latestPose.hasUpdate() && std::chrono::steady_clock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    updatePose();
   }
 }
 
+// Software re-zero: the latest pose produced by the callback becomes the
+// origin of the following ones. Only the origin is moved: the output pose is
+// written by the callback and updatePose() alone, and samples produced up to
+// the switch are skipped by the readers, so getPose() keeps the previous
+// pose until a sample in the new origin is captured. In hardware mode the
+// T265 is then restarted in background, the caller never waits for it.
 void RealSense::resetPoseTrack()
 {
-  pipelines[T265].stop();
+  if (trackingDevice < 0)
+    return;
+
+  {
+    std::lock_guard<std::mutex> lock(originMutex);
+    poseOrigin     = composePose(poseOrigin, lastPoseOutput);
+    lastPoseOutput = composePose(inversePose(lastPoseOutput), lastPoseOutput); // in the new origin
+    originSwitchTs.store(lastPoseTs, std::memory_order_release);
+  }
+
+  if (resetMode == RESET_HARDWARE && !resetting.exchange(true)) {
+    if (resetThread.joinable())
+      resetThread.join();
+    resetThread = std::thread(&RealSense::restartPoseTrack, this);
+  }
+}
+
+void RealSense::setPoseResetMode(poseResetMode mode)
+{
+  resetMode = mode;
+}
+
+// Restarts the T265 pipeline (background thread). The origin is moved by the
+// callback on the first new sample so that poses stay continuous.
+void RealSense::restartPoseTrack()
+{
+  devices.stop(trackingDevice);
   std::this_thread::sleep_for( std::chrono::seconds( 1 ) );
-  pipelines[T265].start(config[T265]);
+  poseClock.reset();
+  restartPending.store(true, std::memory_order_release);
+  devices.start(trackingDevice);
+  resetting.store(false, std::memory_order_release);
+}
+
+// T265 pipeline callback (librealsense thread)
+void RealSense::poseCallback(const rs2::frame & f)
+{
+  if (!f.is<rs2::pose_frame>())
+    return;
+
+  PoseSample sample;
+  rs2_pose raw     = f.as<rs2::pose_frame>().get_pose_data();
+  sample.timestamp = poseClock.update(f);
+
+  {
+    std::lock_guard<std::mutex> lock(originMutex);
+
+    // First pose after a hardware restart: continue from the last output
+    if (restartPending.exchange(false, std::memory_order_acq_rel))
+      poseOrigin = composePose(raw, inversePose(lastPoseOutput));
+
+    sample.pose    = composePose(inversePose(poseOrigin), raw);
+    lastPoseOutput = sample.pose;
+    lastPoseTs     = sample.timestamp;
+  }
+
+  poseRing.push(sample);
+  latestPose.publish(sample);
+}
+
+// Streams gyro and accel of the motion sensor, outside of the pipeline, to
+// the IMU callback. Returns false if the device has no IMU.
+bool RealSense::startImu(const rs2::device & dev)
+{
+  for (auto&& s : dev.query_sensors())
+  {
+    if (!s.is<rs2::motion_sensor>())
+      continue;
+
+    std::vector<rs2::stream_profile> profiles;
+    for (auto&& p : s.get_stream_profiles())
+    {
+      if (p.format() != RS2_FORMAT_MOTION_XYZ32F)
+        continue;
+      if ((p.stream_type() == RS2_STREAM_GYRO && p.fps() == (int)gyro_fps) ||
+          (p.stream_type() == RS2_STREAM_ACCEL && p.fps() == (int)accel_fps))
+        profiles.push_back(p);
+    }
+
+    if (profiles.size() != 2) {
+      std::cerr << "IMU profiles not available (gyro " << gyro_fps << " Hz, accel " << accel_fps << " Hz)." << std::endl;
+      return(false);
+    }
+
+    imuSensor = s;
+    imuSensor.open(profiles);
+    imuSensor.start([this](rs2::frame f) { imuCallback(f); });
+    imuStreaming = true;
+    std::cout << "IMU streaming (gyro " << gyro_fps << " Hz, accel " << accel_fps << " Hz)." << std::endl;
+    return(true);
+  }
+
+  std::cerr << "No IMU found on the depth camera." << std::endl;
+  return(false);
+}
+
+void RealSense::stopImu()
+{
+  if (!imuStreaming)
+    return;
+
+  imuSensor.stop();
+  imuSensor.close();
+  imuStreaming = false;
+}
+
+// Motion sensor callback (librealsense thread)
+void RealSense::imuCallback(const rs2::frame & f)
+{
+  if (!f.is<rs2::motion_frame>())
+    return;
+
+  MotionSample sample;
+  sample.timestamp = imuClock.update(f);
+  sample.value     = f.as<rs2::motion_frame>().get_motion_data();
+
+  if (f.get_profile().stream_type() == RS2_STREAM_GYRO)
+    gyroHistory.push(sample);
+  else
+    accelHistory.push(sample);
+}
+
+// Preintegrates the IMU history between t0 and t1 (common domain, ms)
+bool RealSense::getImuDelta(rs2_time_t t0, rs2_time_t t1, ImuDelta & delta)
+{
+  std::vector<MotionSample> gyro, accel;
+  if (!gyroHistory.copyRange(t0, t1, gyro) || !accelHistory.copyRange(t0, t1, accel))
+    return(false);
+
+  return(imuPreintegrate(gyro, accel, t0, t1, delta));
 }
 
 void RealSense::enableLaser(float power)
@@ -427,75 +908,137 @@ void RealSense::disableLaser()
 // Finalize
 void RealSense::finalize()
 {
+  stopCapture();
+  stopRecording();
+  stopImu();
+  if (resetThread.joinable())
+    resetThread.join();
   cv::destroyAllWindows();
   if (sensorModality != MULTI) {
     pipeline.stop();
   } else {
-    pipelines[D435I].stop();
-    pipelines[T265].stop();
+    devices.stopAll();
+  }
+}
+
+// Update all the streams of the current modality
+void RealSense::updateStreams()
+{
+  switch (sensorModality)
+  {
+    case RGBD:
+      updateRGBD();
+      break;
+    case IRD:
+      updateIRD();
+      break;
+    case IRL:
+      updateIRL();
+      break;
+    case IRR:
+      updateIRR();
+      break;
+    case MULTI:
+      updateMULTI();
+      break;
+    default:
+      break;
   }
+
+  if (recorder.isOpen())
+    recordFrameset();
+}
+
+// Record the current frameset
+void RealSense::recordFrameset()
+{
+  RecordFrame f;
+  f.irLeft          = ir_left_handle.view;
+  f.irLeftTimestamp = ir_left_handle.timestamp;
+  f.depth           = depth_handle.view;
+  f.depthTimestamp  = depth_handle.timestamp;
+  f.color           = color_handle.view;
+  f.colorTimestamp  = color_handle.timestamp;
+  f.pose          = getPose();
+  f.poseTimestamp = getPoseTimestamp();
+
+  recorder.write(f);
+}
+
+bool RealSense::startRecording(const std::string & path)
+{
+  return(recorder.open(path));
+}
+
+void RealSense::stopRecording()
+{
+  recorder.close();
 }
 
 // Update Data
 void RealSense::updateRGBD()
 {
-  updateFrame();
+  if (alignMode == ALIGN_TABLES) {
+    updateColor();
+    updateDepth();
+
+    // Register depth into the color geometry
+    cv::Mat registered = registration.process(depth_handle.view);
+    depth_handle = FrameHandle(registered, registration.getBuffer(), depth_handle.timestamp, depth_handle.frameNumber, depth_handle.domain);
+    return;
+  }
+
+  // Retrieve Aligned Frame
+  aligned_frameset = aligner->process( frameset );
+  if( !aligned_frameset.size() ){
+    return;
+  }
+
   updateColor();
   updateDepth();
 }
 
 void RealSense::updateIRD()
 {
-  updateFrame();
   updateInfraredIRLeft();
   updateDepth();
 }
 
 void RealSense::updateIRL()
 {
-  updateFrame();
   updateInfraredIRLeft();
 }
 
 void RealSense::updateIRR()
 {
-  updateFrame();
   updateInfraredIRRight();
 }
 
 void RealSense::updateMULTI()
 {
-  updateFrame();
   updateInfraredIRLeft();
   updateDepth();
   updatePose();
   updateColor();
 }
 
-// Update Frame
+// Update Frame (blocking)
 inline void RealSense::updateFrame()
 {
   if (sensorModality != MULTI) {
     frameset = pipeline.wait_for_frames();
-
-    if (sensorModality == RGBD) {
-      // Retrieve Aligned Frame
-      rs2::align align( rs2_stream::RS2_STREAM_COLOR );
-      aligned_frameset = align.process( frameset );
-      if( !aligned_frameset.size() ){
-        return;
-      }
-    }
-  } else {
-    frameset  = pipelines[D435I].wait_for_frames();
-    frameset2 = pipelines[T265].wait_for_frames();
+  } else if (!depthDevices.empty()) {
+    frameset = devices.getQueue(depthDevices[D435I]).wait_for_frame();
   }
+
+  if (frameset)
+    observeFrameset(frameset, D435I);
 }
 
 // Update Color
 inline void RealSense::updateColor()
 {
-  if (sensorModality == RGBD)
+  if (sensorModality == RGBD && alignMode == ALIGN_LIBREALSENSE)
     color_frame = aligned_frameset.get_color_frame();
   else
     color_frame = frameset.get_color_frame();
@@ -503,12 +1046,14 @@ inline void RealSense::updateColor()
   // Retrieve Frame Information
   color_width = color_frame.as<rs2::video_frame>().get_width();
   color_height = color_frame.as<rs2::video_frame>().get_height();
+  color_handle = FrameHandle::fromFrame(color_frame, CV_8UC3);
+  mapTimestamp(color_handle);
 }
 
 // Update Depth
 inline void RealSense::updateDepth()
 {
-  if (sensorModality == RGBD)
+  if (sensorModality == RGBD && alignMode == ALIGN_LIBREALSENSE)
     depth_frame = aligned_frameset.get_depth_frame();
   else
     depth_frame = frameset.get_depth_frame();
@@ -516,6 +1061,8 @@ inline void RealSense::updateDepth()
   // Retrieve Frame Information
   depth_width = depth_frame.as<rs2::video_frame>().get_width();
   depth_height = depth_frame.as<rs2::video_frame>().get_height();
+  depth_handle = FrameHandle::fromFrame(depth_frame, CV_16UC1);
+  mapTimestamp(depth_handle);
 }
 
 // Update Infrared (Left)
@@ -523,9 +1070,16 @@ inline void RealSense::updateInfraredIRLeft()
 {
   ir_left_frame  = frameset.get_infrared_frame(IR_LEFT);
 
+  // Post-processed framesets come with the IR image in the depth geometry
+  if (postProcessor.isEnabled() && !processed_ir_left.empty())
+    ir_left_handle = processed_ir_left;
+  else
+    ir_left_handle = FrameHandle::fromFrame(ir_left_frame, CV_8UC1);
+  mapTimestamp(ir_left_handle);
+
   // Retrieve Frame Information
-  ir_left_width  = ir_left_frame.as<rs2::video_frame>().get_width();
-  ir_left_height = ir_left_frame.as<rs2::video_frame>().get_height();
+  ir_left_width  = ir_left_handle.view.cols;
+  ir_left_height = ir_left_handle.view.rows;
 }
 
 // Update Infrared (Right)
@@ -536,13 +1090,22 @@ inline void RealSense::updateInfraredIRRight()
   // Retrive Frame Information
   ir_right_width  = ir_right_frame.as<rs2::video_frame>().get_width();
   ir_right_height = ir_right_frame.as<rs2::video_frame>().get_height();
+  ir_right_handle = FrameHandle::fromFrame(ir_right_frame, CV_8UC1);
+  mapTimestamp(ir_right_handle);
 }
 
-// Update Pose
+// Update Pose (latest sample from the T265 callback)
 inline void RealSense::updatePose()
 {
-  auto pose_frame = frameset2.get_pose_frame();
-  pose = pose_frame.get_pose_data();
+  if (!latestPose.update())
+    return;
+
+  // Produced before the last re-zero
+  if (latestPose.read().timestamp <= originSwitchTs.load(std::memory_order_acquire))
+    return;
+
+  pose           = latestPose.read().pose;
+  pose_timestamp = latestPose.read().timestamp;
 }
 
 // Draw Data
@@ -2,10 +2,26 @@
 #define __REALSENSE__
 
 #include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 #include <librealsense2/rs.hpp>
 #include <opencv2/opencv.hpp>
-
-class RealSense
+#include "tripleBuffer.hpp"
+#include "spscRing.hpp"
+#include "frameRecorder.hpp"
+#include "frameSource.hpp"
+#include "depthRegistration.hpp"
+#include "depthPostProcessor.hpp"
+#include "deviceManager.hpp"
+#include "clockDomain.hpp"
+#include "historyRing.hpp"
+#include "imuPreintegration.hpp"
+#include "calibrationCache.hpp"
+#include "exposureMonitor.hpp"
+
+class RealSense : public FrameSource
 {
 public:
   // These enums are for setting the RealSense modalities.
@@ -14,19 +30,63 @@ public:
   // IRL  - Uses Infrared Left camera
   // IRR  - Uses Infrared Right camera
   // MULTI - Uses Infrared Left camera and Depth camera from D435i and pose from T265
+  //         (any number of depth cameras, the first one feeds the frame getters)
   enum sModality { RGBD, IRD, IRL, IRR, MULTI };
 
+  // Depth to color alignment used by the RGBD modality.
+  // ALIGN_LIBREALSENSE - rs2::align processing block (cached for the pipeline life)
+  // ALIGN_TABLES       - in-house registration with precomputed projection tables
+  enum alignMethod { ALIGN_LIBREALSENSE, ALIGN_TABLES };
+
+  // T265 pose track reset.
+  // RESET_SOFTWARE - the current pose becomes the origin of the following ones
+  // RESET_HARDWARE - same, and the T265 pipeline is restarted in background
+  //                  (poses stay continuous across the restart)
+  enum poseResetMode { RESET_SOFTWARE, RESET_HARDWARE };
+
+  // Pose stream buffering (~1.3 s at the T265 200 Hz pose rate)
+  static const size_t POSE_RING_SIZE = 256;
+
+  // IMU history (~5 s of gyro samples at 400 Hz)
+  static const size_t IMU_HISTORY_SIZE = 2048;
+
 private:
   // Sensor modality
   sModality sensorModality;
 
   // RealSense
   rs2::pipeline pipeline;
-  std::vector<rs2::pipeline> pipelines; // for multicamera
+
+  // Multicamera: one pipeline per device, indices into the device manager
+  DeviceManager devices;
+  std::vector<int> depthDevices;
+  int trackingDevice = -1;
   rs2::pipeline_profile pipeline_profile;
   rs2::frameset aligned_frameset;
   rs2::device realSense_device;
 
+  // Depth to color alignment
+  alignMethod alignMode = ALIGN_LIBREALSENSE;
+  std::unique_ptr<rs2::align> aligner;
+  DepthRegistration registration;
+
+  // Depth post-processing, run by a worker thread between the capture
+  // thread and tryGetLatest() so that it does not delay the consumer
+  struct ProcessedFrameset {
+    rs2::frameset frameset;
+    FrameHandle irLeft; // IR left in the (possibly decimated) depth geometry
+  };
+  DepthPostProcessor postProcessor;
+  std::thread processingThread;
+  std::atomic<bool> processing{false};
+  TripleBuffer<ProcessedFrameset> processedFramesets;
+  std::mutex processMutex;
+  std::condition_variable processCv;
+  FrameHandle processed_ir_left;
+
+  // Pinned frames of the current frameset, with their cached metadata
+  FrameHandle color_handle, depth_handle, ir_left_handle, ir_right_handle;
+
   // Color Buffer
   rs2::frame color_frame;
   cv::Mat color_mat;
@@ -57,27 +117,69 @@ private:
 
   // Pose buffer
   rs2_pose pose;
-
-  // Warmup frames
+  rs2_time_t pose_timestamp = -1;
+
+  // T265 pose stream, filled by the pipeline callback at the native rate
+  SpscRing<PoseSample, POSE_RING_SIZE> poseRing;
+  TripleBuffer<PoseSample> latestPose;
+  uint32_t pose_wait_ms = 5000;
+
+  // Pose track origin: poses are produced relative to it by the callback.
+  // Queued samples older than originSwitchTs are in the previous origin
+  // frame and are dropped by the readers.
+  poseResetMode resetMode = RESET_SOFTWARE;
+  std::mutex originMutex;
+  rs2_pose poseOrigin;
+  rs2_pose lastPoseOutput;     // written by the callback
+  rs2_time_t lastPoseTs = -1;
+  std::atomic<double> originSwitchTs{-1};
+  std::atomic<bool> restartPending{false};
+  std::thread resetThread;
+  std::atomic<bool> resetting{false};
+
+  // D435i IMU, streamed by the motion sensor callback (timestamps in the
+  // common domain, values in the IMU frame)
+  HistoryRing<MotionSample, IMU_HISTORY_SIZE> gyroHistory;
+  HistoryRing<MotionSample, IMU_HISTORY_SIZE> accelHistory;
+  ClockDomain imuClock;
+  rs2::sensor imuSensor;
+  bool imuStreaming = false;
+  uint32_t gyro_fps = 200;
+  uint32_t accel_fps = 250;
+
+  // Warmup frames (upper bound, warm-up ends when auto-exposure is stable)
   uint32_t warm_up_frames = 30;
 
-  // Framesets
-  rs2::frameset frameset, frameset2;
+  // Device calibrations, cached by serial number
+  CalibrationCache calibrationCache;
 
-  // Error
-  rs2_error * e = 0;
+  // Framesets
+  rs2::frameset frameset;
 
   // Maximum delta between RGB and Depth image timeframes (time in ms)
   rs2_time_t maxDeltaTimeframes;
   rs2_time_t MIN_DELTA_TIMEFRAMES_THRESHOLD = 20;
 
   enum irCamera { IR_LEFT = 1, IR_RIGHT = 2 };
-  enum frameCamera { D435I = 0, T265 = 1 };
-
-  // Capture serial numbers before opening streaming
-  std::vector<std::string> serials, names;
+  // Frameset channel of the primary depth camera
+  enum frameCamera { D435I = 0 };
 
   std::vector<rs2::config> config;
+
+  // Capture threads (one per depth camera) publishing the latest framesets
+  std::vector<std::thread> captureThreads;
+  std::atomic<bool> capturing{false};
+  std::vector<std::unique_ptr<TripleBuffer<rs2::frameset>>> latestFramesets;
+
+  // Device to host clock mapping: every timestamp returned by this class is
+  // on the host monotonic clock [ms], whatever device it comes from
+  std::vector<std::unique_ptr<ClockDomain>> depthClocks; // one per capture channel
+  ClockDomain poseClock;
+  uint32_t capture_timeout_ms = 1000;
+  uint32_t capture_poll_us = 500;
+
+  // Frameset recorder
+  FrameRecorder recorder;
 public:
   // Constructor
   RealSense(const sModality);
@@ -91,9 +193,23 @@ public:
   // Destructor
   ~RealSense();
 
-  // Process
+  // Process (blocks until a new frameset is available)
   void run();
 
+  // Background capture
+  void startCapture();
+  void stopCapture();
+
+  // Non-blocking: consumes the latest captured frameset, false if none is new
+  bool tryGetLatest();
+
+  // Additional depth cameras (MULTI): channel 0 is the primary camera,
+  // consumed by tryGetLatest(), the others can be read with
+  // tryGetLatestFrameset() while capturing
+  size_t getDepthDeviceCount();
+  bool tryGetLatestFrameset(size_t, rs2::frameset &);
+  DeviceManager & getDeviceManager();
+
   // Operations with frame timestamps
   rs2_time_t getRGBTimestamp();
   rs2_time_t getDepthTimestamp();
@@ -110,17 +226,39 @@ public:
   cv::Mat getIRLeftMatrix();
   cv::Mat getIRRightMatrix();
 
+  // Get pinned frames
+  FrameHandle getColorHandle();
+  FrameHandle getDepthHandle();
+  FrameHandle getIRLeftHandle();
+
   // Get pose
   rs2_pose getPose();
 
+  // Pops the oldest queued T265 pose sample (native rate stream), false if none
+  bool popPoseSample(rs2_pose &, rs2_time_t &);
+
   // Get raw frames
   rs2::frame getColorFrame();
   rs2::frame getDepthFrame();
   rs2::frame getIRLeftFrame();
   rs2::frame getIRRightFrame();
 
-  // Reset pose tracking
+  // Reset pose tracking (non-blocking, the current pose becomes the origin)
   void resetPoseTrack();
+  void setPoseResetMode(poseResetMode);
+
+  // Preintegrated D435i IMU motion between two timestamps
+  bool getImuDelta(rs2_time_t, rs2_time_t, ImuDelta &);
+
+  // Record every processed frameset to a file (see FrameReplay)
+  bool startRecording(const std::string &);
+  void stopRecording();
+
+  // Configure the depth post-processing chain (call before consuming framesets)
+  bool setDepthPostProcessing(const DepthFilterConfig &);
+
+  // Select the RGBD depth to color alignment method
+  void setAlignMethod(alignMethod);
 
   // Control laser projector
   void enableLaser(float);
@@ -133,11 +271,50 @@ private:
 
   // Initialize Sensor
   inline void initializeSensor();
+  void initializeAlignment();
+  void printCalibration(const StereoCalibration &);
   inline void initializeSensors();
 
   // Finalize
   void finalize();
 
+  // Capture thread bodies (pipeline polling, device frame queue)
+  void captureLoop(rs2::pipeline, unsigned int);
+  void queueLoop(rs2::frame_queue, unsigned int);
+  void publishFrameset(const rs2::frameset &, unsigned int);
+
+  // Clock domain mapping of the frameset arrivals and of the frame handles
+  void observeFrameset(const rs2::frameset &, unsigned int);
+  void mapTimestamp(FrameHandle &);
+
+  // Depth post-processing worker
+  void startProcessing();
+  void stopProcessing();
+  void processingLoop();
+  void postProcess();
+
+  // T265 pipeline callback
+  void poseCallback(const rs2::frame &);
+
+  // Background T265 pipeline restart
+  void restartPoseTrack();
+
+  // D435i motion sensor streaming and callback
+  bool startImu(const rs2::device &);
+  void stopImu();
+  void imuCallback(const rs2::frame &);
+
+  // Conversion from the T265 reference frame
+  rs2_pose convertPose(const rs2_pose &);
+  rs2_vector convertLinear(const rs2_vector &);
+  rs2_vector convertAngular(const rs2_vector &);
+
+  // Updates all the streams of the selected modality from the current frameset
+  void updateStreams();
+
+  // Writes the current frameset to the recorder
+  void recordFrameset();
+
   // Updates for aligned RGBD frames
   // Update Data
   void updateRGBD();
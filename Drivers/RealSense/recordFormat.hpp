@@ -0,0 +1,77 @@
+#ifndef __RECORDFORMAT__
+#define __RECORDFORMAT__
+
+#include <cstdint>
+#include <cstddef>
+#include <librealsense2/rs.hpp>
+#include <opencv2/opencv.hpp>
+
+// On-disk layout of a perceptor recording.
+//
+// The file is a sequence of fixed size chunks. The first chunk starts with a
+// RecordFileHeader, then records follow each other 64 bytes aligned. A record
+// never straddles two chunks: when it does not fit in the current chunk the
+// writer moves to the next one and the (zeroed) tail is skipped by the reader.
+// Each record is a RecordHeader followed by the IR left, depth and color
+// images, packed row by row.
+namespace record {
+
+const char     FILE_MAGIC[8]  = { 'P', 'R', 'C', 'P', 'R', 'E', 'C', '\0' };
+const uint32_t FILE_VERSION   = 1;
+const uint32_t RECORD_MAGIC   = 0x44524352; // "RCRD"
+const size_t   ALIGNMENT      = 64;
+const size_t   HEADER_SIZE    = 4096;
+const size_t   DEFAULT_CHUNK_SIZE = 64 * 1024 * 1024;
+
+struct RecordFileHeader {
+  char     magic[8];
+  uint32_t version;
+  uint32_t reserved;
+  uint64_t chunkSize;
+  uint64_t recordCount;
+  uint64_t dataEnd;
+};
+
+struct RecordStream {
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;  // bytes per row
+  int32_t  type;    // OpenCV matrix type
+  uint64_t offset;  // from the beginning of the record
+  uint64_t size;    // 0 if the stream was not available
+  double   timestamp;
+};
+
+struct RecordHeader {
+  uint32_t     magic;
+  uint32_t     reserved;
+  uint64_t     size;  // whole record, header and padding included
+  uint64_t     index;
+  RecordStream irLeft;
+  RecordStream depth;
+  RecordStream color;
+  rs2_pose     pose;
+  double       poseTimestamp;
+};
+
+inline size_t align(size_t v)
+{
+  return (v + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+}
+
+} // namespace record
+
+// A single frameset as written to / read from a recording.
+// When read back from a replay the matrices point into the file mapping.
+struct RecordFrame {
+  cv::Mat irLeft;
+  cv::Mat depth;
+  cv::Mat color;
+  rs2_time_t irLeftTimestamp = -1;
+  rs2_time_t depthTimestamp = -1;
+  rs2_time_t colorTimestamp = -1;
+  rs2_pose pose;
+  rs2_time_t poseTimestamp = -1;
+};
+
+#endif // __RECORDFORMAT__
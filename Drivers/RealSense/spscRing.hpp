@@ -0,0 +1,89 @@
+#ifndef __SPSCRING__
+#define __SPSCRING__
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free single producer / single consumer ring buffer.
+// S must be a power of two. When the ring is full new samples are dropped
+// (and counted), so the producer never blocks.
+template <typename T, size_t S>
+class SpscRing {
+  static_assert(S >= 2 && (S & (S - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+
+  /* Constructor
+   */
+  SpscRing()
+  : m_head(0), m_tail(0), m_dropped(0)
+  {
+  }
+
+  /* push(v): producer side, appends v. Returns false if the ring is full.
+   */
+  bool push(const T & v)
+  {
+    const size_t head = m_head.load(std::memory_order_relaxed);
+    if (head - m_tail.load(std::memory_order_acquire) == S) {
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+
+    m_buf[head & MASK] = v;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* pop(v): consumer side, removes the oldest sample into v. Returns false
+   * if the ring is empty.
+   */
+  bool pop(T & v)
+  {
+    const size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire))
+      return false;
+
+    v = m_buf[tail & MASK];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* size(): number of samples currently queued (approximate if called
+   * concurrently with push/pop).
+   */
+  size_t size() const
+  {
+    return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+  }
+
+  bool empty() const
+  {
+    return size() == 0;
+  }
+
+  /* dropped(): number of samples rejected because the ring was full.
+   */
+  size_t dropped() const
+  {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+
+  static const size_t MASK = S - 1;
+
+  static const size_t CACHE_LINE = 64;
+
+  // Head and tail are kept on separate cache lines to avoid false sharing
+  T m_buf[S];
+  std::atomic<size_t> m_head; // written by the producer
+  char m_pad[CACHE_LINE - sizeof(std::atomic<size_t>)];
+  std::atomic<size_t> m_tail; // written by the consumer
+  std::atomic<size_t> m_dropped;
+
+  SpscRing(const SpscRing &) = delete;
+  SpscRing & operator=(const SpscRing &) = delete;
+};
+
+#endif // __SPSCRING__
@@ -0,0 +1,79 @@
+#ifndef __TRIPLEBUFFER__
+#define __TRIPLEBUFFER__
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single producer / single consumer triple buffer.
+// The producer always owns one slot (back), the consumer always owns one slot
+// (front) and the third slot (middle) is exchanged atomically between them,
+// so neither side ever waits for the other and the consumer always sees the
+// most recently published value.
+template <typename T>
+class TripleBuffer {
+public:
+
+  /* Constructor
+   */
+  TripleBuffer()
+  : m_state(MIDDLE_INIT), m_back(BACK_INIT), m_front(FRONT_INIT)
+  {
+  }
+
+  /* publish(v): producer side, stores v in the back slot and swaps it
+   * with the middle slot, marking it as fresh for the consumer.
+   */
+  void publish(const T & v)
+  {
+    m_buf[m_back] = v;
+    uint8_t prev = m_state.exchange(m_back | DIRTY, std::memory_order_acq_rel);
+    m_back = prev & INDEX_MASK;
+  }
+
+  /* update(): consumer side, swaps the front slot with the middle one if
+   * the producer published something new since the last call. Returns
+   * false (and leaves the front slot untouched) otherwise.
+   */
+  bool update()
+  {
+    if (!(m_state.load(std::memory_order_acquire) & DIRTY))
+      return false;
+
+    uint8_t prev = m_state.exchange(m_front, std::memory_order_acq_rel);
+    m_front = prev & INDEX_MASK;
+    return true;
+  }
+
+  /* read(): consumer side, returns the value swapped in by the last
+   * successful update().
+   */
+  const T & read() const
+  {
+    return m_buf[m_front];
+  }
+
+  /* hasUpdate(): true if a value was published and not yet consumed.
+   */
+  bool hasUpdate() const
+  {
+    return (m_state.load(std::memory_order_acquire) & DIRTY) != 0;
+  }
+
+private:
+
+  static const uint8_t INDEX_MASK  = 0x03;
+  static const uint8_t DIRTY       = 0x04;
+  static const uint8_t FRONT_INIT  = 0;
+  static const uint8_t MIDDLE_INIT = 1;
+  static const uint8_t BACK_INIT   = 2;
+
+  T m_buf[3];
+  std::atomic<uint8_t> m_state; // middle slot index + dirty flag
+  uint8_t m_back;               // owned by the producer
+  uint8_t m_front;              // owned by the consumer
+
+  TripleBuffer(const TripleBuffer &) = delete;
+  TripleBuffer & operator=(const TripleBuffer &) = delete;
+};
+
+#endif // __TRIPLEBUFFER__
@@ -0,0 +1,194 @@
+#include "synthetic.hpp"
+
+#include <thread>
+#include <cmath>
+#include <algorithm>
+
+// Deterministic integer hash used to generate the textures
+static inline uint32_t hash(uint32_t x, uint32_t y)
+{
+  uint32_t h = x * 374761393u + y * 668265263u;
+  h = (h ^ (h >> 13)) * 1274126177u;
+  return(h ^ (h >> 16));
+}
+
+// Constructor
+SyntheticSource::SyntheticSource(uint32_t _width, uint32_t _height, double _fps, double _poseRate):
+width(_width), height(_height), fps(_fps), poseRate(_poseRate), frameIndex(0), started(false), poseIndex(0)
+{
+  generateTextures();
+  startTime = std::chrono::steady_clock::now();
+  updateFrame(0);
+
+  std::cout << "Synthetic source initialized: " << width << "x" << height << " @ " << fps << " fps, poses @ " << poseRate << " Hz" << std::endl;
+}
+
+// Destructor
+SyntheticSource::~SyntheticSource()
+{}
+
+// Textures are made of 8x8 pixel blocks of pseudo-random intensity, giving
+// plenty of corners to the ORB extractor. Depth is a slanted plane.
+void SyntheticSource::generateTextures()
+{
+  const uint32_t tw = 2 * width, th = 2 * height;
+  const uint32_t BLOCK = 8;
+
+  irData.resize((size_t)tw * th);
+  depthData.resize((size_t)tw * th * 2);
+  colorData.resize((size_t)tw * th * 3);
+
+  uint16_t * depth = reinterpret_cast<uint16_t *>(depthData.data());
+  for (uint32_t y = 0; y < th; y++)
+  {
+    for (uint32_t x = 0; x < tw; x++)
+    {
+      size_t i = (size_t)y * tw + x;
+      uint8_t v = hash(x / BLOCK, y / BLOCK) & 0xFF;
+      irData[i] = v;
+      depth[i]  = (uint16_t)(1500 + (y * 1000) / th); // 1.5 m to 2.5 m
+      colorData[3 * i + 0] = v;
+      colorData[3 * i + 1] = (uint8_t)((x * 255) / tw);
+      colorData[3 * i + 2] = (uint8_t)((y * 255) / th);
+    }
+  }
+
+  irTexture    = cv::Mat(th, tw, CV_8UC1, irData.data());
+  depthTexture = cv::Mat(th, tw, CV_16UC1, depthData.data());
+  colorTexture = cv::Mat(th, tw, CV_8UC3, colorData.data());
+}
+
+double SyntheticSource::elapsedMs()
+{
+  return(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count());
+}
+
+double SyntheticSource::frameTimestamp(uint64_t idx)
+{
+  return(idx * 1000.0 / fps);
+}
+
+// Index of the most recent frame due on the wall clock
+uint64_t SyntheticSource::dueFrame()
+{
+  return((uint64_t)(elapsedMs() * fps / 1000.0));
+}
+
+// Images are zero-copy views panned over the textures following the trajectory
+void SyntheticSource::updateFrame(uint64_t idx)
+{
+  frameIndex = idx;
+
+  rs2_pose p = poseAt(frameTimestamp(idx));
+  uint32_t x0 = (uint32_t)((p.translation.x / radius + 1.0) * 0.5 * width) % width;
+  uint32_t y0 = (uint32_t)((p.translation.y / radius + 1.0) * 0.5 * height) % height;
+
+  irMatrix    = cv::Mat(height, width, CV_8UC1, irData.data() + (size_t)y0 * 2 * width + x0, 2 * width);
+  depthMatrix = cv::Mat(height, width, CV_16UC1, depthData.data() + ((size_t)y0 * 2 * width + x0) * 2, 2 * width * 2);
+  colorMatrix = cv::Mat(height, width, CV_8UC3, colorData.data() + ((size_t)y0 * 2 * width + x0) * 3, 2 * width * 3);
+}
+
+void SyntheticSource::run()
+{
+  uint64_t target = started ? frameIndex + 1 : 0;
+  double wait = frameTimestamp(target) - elapsedMs();
+  if (wait > 0)
+    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(wait));
+
+  started = true;
+  updateFrame(std::max(target, dueFrame()));
+}
+
+bool SyntheticSource::tryGetLatest()
+{
+  uint64_t due = dueFrame();
+  if (started && due <= frameIndex)
+    return(false);
+
+  started = true;
+  updateFrame(due);
+  return(true);
+}
+
+// Circular trajectory in the (x, y) plane, heading tangent to the circle
+rs2_pose SyntheticSource::poseAt(double timestamp)
+{
+  double t   = timestamp / 1000.0;
+  double yaw = angularRate * t;
+
+  rs2_pose p = {};
+  p.translation.x      = (float)(radius * sin(yaw));
+  p.translation.y      = (float)(radius * (1.0 - cos(yaw)));
+  p.translation.z      = 0.0f;
+  p.velocity.x         = (float)(radius * angularRate * cos(yaw));
+  p.velocity.y         = (float)(radius * angularRate * sin(yaw));
+  p.rotation.w         = (float)cos(yaw / 2.0);
+  p.rotation.x         = 0.0f;
+  p.rotation.y         = 0.0f;
+  p.rotation.z         = (float)sin(yaw / 2.0);
+  p.angular_velocity.z = (float)angularRate;
+  p.tracker_confidence = 3;
+  p.mapper_confidence  = 3;
+  return(p);
+}
+
+rs2_time_t SyntheticSource::getIRLeftTimestamp()
+{
+  return(frameTimestamp(frameIndex));
+}
+
+rs2_time_t SyntheticSource::getPoseTimestamp()
+{
+  return(frameTimestamp(frameIndex));
+}
+
+cv::Mat SyntheticSource::getColorMatrix()
+{
+  return(colorMatrix);
+}
+
+cv::Mat SyntheticSource::getDepthMatrix()
+{
+  return(depthMatrix);
+}
+
+cv::Mat SyntheticSource::getIRLeftMatrix()
+{
+  return(irMatrix);
+}
+
+FrameHandle SyntheticSource::getColorHandle()
+{
+  return(FrameHandle(colorMatrix, nullptr, frameTimestamp(frameIndex), frameIndex));
+}
+
+FrameHandle SyntheticSource::getDepthHandle()
+{
+  return(FrameHandle(depthMatrix, nullptr, frameTimestamp(frameIndex), frameIndex));
+}
+
+FrameHandle SyntheticSource::getIRLeftHandle()
+{
+  return(FrameHandle(irMatrix, nullptr, frameTimestamp(frameIndex), frameIndex));
+}
+
+rs2_pose SyntheticSource::getPose()
+{
+  return(poseAt(frameTimestamp(frameIndex)));
+}
+
+// Pose samples are generated at poseRate up to the current wall clock time
+bool SyntheticSource::popPoseSample(rs2_pose & _pose, rs2_time_t & _timestamp)
+{
+  double timestamp = poseIndex * 1000.0 / poseRate;
+  if (timestamp > elapsedMs())
+    return(false);
+
+  _pose      = poseAt(timestamp);
+  _timestamp = timestamp;
+  poseIndex++;
+  return(true);
+}
+
+void SyntheticSource::resetPoseTrack()
+{}
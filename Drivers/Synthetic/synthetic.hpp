@@ -0,0 +1,83 @@
+#ifndef __SYNTHETIC__
+#define __SYNTHETIC__
+
+#include <chrono>
+#include <vector>
+#include "frameSource.hpp"
+
+// Deterministic frame source for load testing without devices.
+// IR left, depth and color images are views over textures generated once at
+// construction, panned according to a circular trajectory which is also
+// served as the T265 pose stream. Frames and poses are functions of their
+// index only, paced on the wall clock at the configured rates.
+class SyntheticSource : public FrameSource
+{
+private:
+  // Image geometry and rates
+  uint32_t width;
+  uint32_t height;
+  double fps;
+  double poseRate;
+
+  // Trajectory: circle of given radius [m] travelled at given angular rate [rad/s]
+  double radius = 0.5;
+  double angularRate = 0.2;
+
+  // Textures (twice the image size, images are panned views over them)
+  cv::Mat irTexture, depthTexture, colorTexture;
+  std::vector<uint8_t> irData, depthData, colorData;
+
+  // Current frameset
+  uint64_t frameIndex;
+  bool started;
+  cv::Mat irMatrix, depthMatrix, colorMatrix;
+
+  // Pose stream
+  uint64_t poseIndex;
+
+  std::chrono::steady_clock::time_point startTime;
+
+public:
+  // Constructor
+  SyntheticSource(uint32_t = 640, uint32_t = 480, double = 30.0, double = 200.0);
+
+  // Destructor
+  ~SyntheticSource();
+
+  // Process (blocks until the next frame is due)
+  void run();
+
+  // Non-blocking: moves to the latest due frame
+  bool tryGetLatest();
+
+  // Operations with frame timestamps
+  rs2_time_t getIRLeftTimestamp();
+  rs2_time_t getPoseTimestamp();
+
+  // Get frame matrices
+  cv::Mat getColorMatrix();
+  cv::Mat getDepthMatrix();
+  cv::Mat getIRLeftMatrix();
+
+  // Get frames (backed by the textures, no owner needed)
+  FrameHandle getColorHandle();
+  FrameHandle getDepthHandle();
+  FrameHandle getIRLeftHandle();
+
+  // Get pose
+  rs2_pose getPose();
+  bool popPoseSample(rs2_pose &, rs2_time_t &);
+
+  // Reset pose tracking (the trajectory is deterministic, nothing to reset)
+  void resetPoseTrack();
+
+private:
+  void generateTextures();
+  void updateFrame(uint64_t);
+  uint64_t dueFrame();
+  rs2_pose poseAt(double);
+  double elapsedMs();
+  double frameTimestamp(uint64_t);
+};
+
+#endif // __SYNTHETIC__
@@ -0,0 +1,59 @@
+#ifndef __FIXEDRING__
+#define __FIXEDRING__
+
+// Fixed-size ring buffer of the last S samples, stored in place: pushing
+// overwrites the oldest sample once the ring is full. Samples are indexed
+// from the oldest (0) to the newest (size() - 1).
+template <typename T, int S>
+class FixedRing {
+public:
+
+  /* Constructor
+   */
+  FixedRing()
+  : m_idx(0), m_cnt(0)
+  {
+  }
+
+  /* push(s): appends the sample s, dropping the oldest one if the ring is
+   * full
+   */
+  void push(const T & s)
+  {
+    m_buf[m_idx] = s;
+    m_idx = (m_idx + 1) % S;
+
+    if(m_cnt < S){
+      m_cnt++;
+    }
+  }
+
+  /* operator[](i): i-th sample, from the oldest one
+   */
+  T & operator[](int i)
+  {
+    return m_buf[(m_idx + S - m_cnt + i) % S];
+  }
+
+  const T & operator[](int i) const
+  {
+    return m_buf[(m_idx + S - m_cnt + i) % S];
+  }
+
+  int size() const
+  {
+    return m_cnt;
+  }
+
+  bool full() const
+  {
+    return m_cnt == S;
+  }
+
+private:
+
+  T m_buf[S];
+  int m_idx, m_cnt;
+};
+
+#endif // __FIXEDRING__
@@ -0,0 +1,66 @@
+#ifndef __FRAMEHANDLE__
+#define __FRAMEHANDLE__
+
+#include <memory>
+#include <librealsense2/rs.hpp>
+#include <opencv2/opencv.hpp>
+
+// Ref-counted handle to an image frame.
+// It keeps the frame memory alive (the rs2::frame for live sources, the
+// owning buffer otherwise) for as long as any copy of the handle exists, and
+// exposes a zero-copy cv::Mat view over it plus the frame metadata, read
+// once when the frameset is received. Copying a handle is cheap and safe
+// across threads.
+class FrameHandle
+{
+public:
+  cv::Mat view;
+  rs2_time_t timestamp;             // [ms], in the source common time domain
+  unsigned long long frameNumber;
+  rs2_timestamp_domain domain;      // domain the device stamped the frame in
+
+private:
+  std::shared_ptr<const void> owner;
+
+public:
+  /* Constructor: empty handle
+   */
+  FrameHandle()
+  : timestamp(-1), frameNumber(0), domain(RS2_TIMESTAMP_DOMAIN_COUNT)
+  {
+  }
+
+  /* Constructor: view over memory kept alive by _owner (may be null when the
+   * memory outlives the handle, e.g. a replay mapping)
+   */
+  FrameHandle(const cv::Mat & _view, std::shared_ptr<const void> _owner, rs2_time_t _timestamp, unsigned long long _frameNumber = 0, rs2_timestamp_domain _domain = RS2_TIMESTAMP_DOMAIN_COUNT)
+  : view(_view), timestamp(_timestamp), frameNumber(_frameNumber), domain(_domain), owner(_owner)
+  {
+  }
+
+  /* fromFrame(f, type): pins a librealsense video frame and caches its metadata
+   */
+  static FrameHandle fromFrame(const rs2::frame & f, int type)
+  {
+    if (!f)
+      return FrameHandle();
+
+    rs2::video_frame vf = f.as<rs2::video_frame>();
+    std::shared_ptr<rs2::frame> pinned = std::make_shared<rs2::frame>(f);
+    cv::Mat view(vf.get_height(), vf.get_width(), type, const_cast<void *>(vf.get_data()), vf.get_stride_in_bytes());
+
+    return FrameHandle(view, pinned, f.get_timestamp(), f.get_frame_number(), f.get_frame_timestamp_domain());
+  }
+
+  bool empty() const
+  {
+    return view.empty();
+  }
+
+  void reset()
+  {
+    *this = FrameHandle();
+  }
+};
+
+#endif // __FRAMEHANDLE__
@@ -0,0 +1,98 @@
+#ifndef __FRAMESOURCE__
+#define __FRAMESOURCE__
+
+#include <string>
+#include <librealsense2/rs.hpp>
+#include <opencv2/opencv.hpp>
+#include "frameHandle.hpp"
+
+// Depth post-processing chain settings (see DepthPostProcessor).
+// Filters are applied in the order they are listed here.
+struct DepthFilterConfig {
+  int   decimation = 1;         // downsampling factor, 1 disables the filter
+  float minDistance = 0.0f;     // range clamp [m], both 0 disable the filter
+  float maxDistance = 0.0f;
+  bool  spatial = false;        // edge-preserving spatial smoothing
+  float spatialAlpha = 0.5f;
+  float spatialDelta = 20.0f;
+  bool  temporal = false;       // temporal smoothing over past frames
+  float temporalAlpha = 0.4f;
+  float temporalDelta = 20.0f;
+  int   holeFilling = -1;       // 0 fill from left, 1 farthest, 2 nearest, -1 disabled
+
+  bool enabled() const
+  {
+    return(decimation > 1 || minDistance > 0.0f || maxDistance > 0.0f || spatial || temporal || holeFilling >= 0);
+  }
+};
+
+// Source of IR/depth/color framesets and T265-like poses for the perceptor
+// node. Implemented by the RealSense driver, by the recording replay and by
+// the synthetic generator, so the node can run without devices.
+// All the timestamps of a source (frames and poses) share one time base.
+class FrameSource
+{
+public:
+  // Pose sample with its timestamp
+  struct PoseSample {
+    rs2_pose pose;
+    rs2_time_t timestamp;
+  };
+
+  // Preintegrated IMU motion between two timestamps, in the IMU frame at
+  // the first timestamp: orientation of the IMU frame at the second timestamp
+  // and velocity change from the measured specific force (gravity included)
+  struct ImuDelta {
+    rs2_quaternion rotation;
+    rs2_vector velocity;
+    rs2_time_t dt;       // [ms]
+    unsigned int samples;
+  };
+
+  virtual ~FrameSource() {}
+
+  // Process (blocks until a new frameset is available)
+  virtual void run() = 0;
+
+  // Non-blocking: moves to the latest frameset, false if none is new
+  virtual bool tryGetLatest() = 0;
+
+  // Background acquisition, if the source needs one
+  virtual void startCapture() {}
+  virtual void stopCapture() {}
+
+  // Operations with frame timestamps
+  virtual rs2_time_t getIRLeftTimestamp() = 0;
+  virtual rs2_time_t getPoseTimestamp() = 0;
+
+  // Get frame matrices (views valid until the next frameset)
+  virtual cv::Mat getColorMatrix() = 0;
+  virtual cv::Mat getDepthMatrix() = 0;
+  virtual cv::Mat getIRLeftMatrix() = 0;
+
+  // Get pinned frames (views valid as long as the handle exists)
+  virtual FrameHandle getColorHandle() = 0;
+  virtual FrameHandle getDepthHandle() = 0;
+  virtual FrameHandle getIRLeftHandle() = 0;
+
+  // Get pose
+  virtual rs2_pose getPose() = 0;
+
+  // Pops the oldest pose sample of the pose stream, false if none
+  virtual bool popPoseSample(rs2_pose &, rs2_time_t &) = 0;
+
+  // Reset pose tracking: the current pose becomes the origin (non-blocking)
+  virtual void resetPoseTrack() = 0;
+
+  // IMU motion between two timestamps, false if no IMU or not covered
+  virtual bool getImuDelta(rs2_time_t, rs2_time_t, ImuDelta &) { return(false); }
+
+  // Depth post-processing, only supported by live sources
+  virtual bool setDepthPostProcessing(const DepthFilterConfig &) { return(false); }
+
+  // Frameset recording, only supported by live sources
+  virtual bool startRecording(const std::string &) { return(false); }
+  virtual void stopRecording() {}
+};
+
+#endif // __FRAMESOURCE__
@@ -2,14 +2,38 @@
 #define __FUSER__
 
 #include <iostream>
+#include <chrono>
 #include "pose.hpp"
-#include "medianFilter.hpp"
-#include <unsupported/Eigen/Splines>
+#include "sortingNetwork.hpp"
+#include "slidingMedian.hpp"
+#include "fixedRing.hpp"
+#include "poseInterpolator.hpp"
 
 #define FILTER_WINDOW   6
 #define RECOVERY_BUFFER 6
+#define SYNC_HISTORY    4 // ORB samples used to synchronize with the T265
 
-class Fuser
+// Quaternion median settings
+#define MEDIAN_SMALL_ANGLE      0.001 // [rad] samples closer than this use the closed-form mean
+#define MEDIAN_WARM_START_ANGLE 0.5   // [rad] max distance of the previous median from the newest sample
+#define MEDIAN_MAX_ITERATIONS   100
+#define MEDIAN_TIME_BUDGET_US   500
+
+// Gating settings
+#define GATING_CHI2           16.81 // chi-square threshold, 6 DoF at 99%
+#define GATING_SMOOTHING      0.05  // innovation covariance update rate
+#define GATING_MIN_SIGMA_T    0.002 // [m] innovation std floor, translation
+#define GATING_MIN_SIGMA_Q    0.001 // innovation std floor, quaternion components
+#define GATING_WARMUP         10    // ORB deltas accepted before gating
+#define GATING_MAX_REJECTIONS 10    // consecutive rejections before re-anchoring ORB
+
+// Fuser for a quaternion median window of W samples (up to 32) and an ORB
+// recovery buffer of R samples. The translation median window is set at
+// runtime: W by default (sorting network medians), sliding medians
+// otherwise. The buffers are only allocated on construction and by
+// setFilterWindow(), so that fusion does not allocate memory.
+template <int W, int R>
+class FuserT
 {
   // Variables
   public:
@@ -25,6 +49,32 @@ class Fuser
       RUNNING = 1
     };
 
+    // ORB outlier rejection: median filters on the ORB and fused poses, or
+    // chi-square gating of the ORB deltas against the T265 ones (no delay)
+    enum outlierRejection {
+      MEDIAN = 0,
+      GATING = 1
+    };
+
+    typedef Eigen::Matrix<double, 7, 1> PoseVector;  // (x, y, z, qw, qx, qy, qz)
+    typedef Eigen::Matrix<double, 4, W> QuaternionSamples; // one quaternion per column
+    typedef Eigen::Matrix<double, 6, 1> GatingVector;      // (x, y, z, qx, qy, qz) innovation
+    typedef Eigen::Matrix<double, 6, 6> GatingMatrix;
+
+    // Statistics of the last quaternion median computation
+    struct MedianStats {
+      unsigned int iterations; // Weiszfeld iterations
+      bool fastPath;           // all samples within MEDIAN_SMALL_ANGLE
+      bool converged;          // false if the budget ran out
+    };
+
+    // Statistics of the last gating test
+    struct GatingStats {
+      double distance;         // squared Mahalanobis distance of the ORB delta
+      bool rejected;
+      unsigned int rejections; // total rejected ORB deltas
+    };
+
   protected:
     Pose pose;
     Pose posePrev;
@@ -43,26 +93,74 @@ class Fuser
     unsigned int fuserStatus;
     unsigned int orbQoS;
     unsigned int camQoS;
-    std::vector<double> deltaCamVO;
-    std::vector<double> deltaOrbVO;
+    PoseVector deltaCamVO;
+    PoseVector deltaOrbVO;
     Pose camVOPrev;
     Pose orbVOPrev;
     Pose firstCamVO;
     Pose camRecover;
     double alphaBlending; // Fuser blending coefficient
     double alphaWeight;   // Fuser weight coefficient
-    std::vector<Pose> orbPoseBuffer;
-    std::vector<Pose> poseBuffer;
-    std::vector<unsigned int> orbQoSPrev, orbQoSFilterReset;
+    FixedRing<Pose, W> orbPoseBuffer;
+    FixedRing<Pose, W> poseBuffer;
+    int filterWindow;                     // translation median window
+    unsigned int filterSpan;              // samples spanned by the medians, max(W, filterWindow)
+    SlidingMedian<double> orbFilters[3];  // translation medians of the ORB poses
+    SlidingMedian<double> poseFilters[3]; // translation medians of the fused poses
+    FixedRing<unsigned int, R> orbQoSPrev;
+    FixedRing<unsigned int, W> orbQoSFilterReset;
     unsigned int counter;
 
+    // Quaternion medians of the previous windows, for warm-starting
+    struct MedianState {
+      Eigen::Quaterniond median;
+      bool valid;
+      MedianStats stats;
+    };
+    MedianState orbMedian;
+    MedianState poseMedian;
+    unsigned int medianMaxIterations;
+    std::chrono::microseconds medianTimeBudget;
+
+    // Gating: innovation covariance, estimated on the accepted ORB deltas
+    enum gatingResult {
+      GATE_ACCEPT = 0,
+      GATE_REJECT = 1,
+      GATE_REANCHOR = 2 // too many rejections, the ORB trajectory jumped
+    };
+    unsigned int rejectionMode;
+    GatingMatrix gatingCovariance;
+    unsigned int gatingSamples;
+    unsigned int gatingConsecutive;
+    GatingStats gatingStats;
+
+    // Latest measurements, for event-driven fusion
+    Pose camLatest;
+    PoseInterpolator<SYNC_HISTORY> orbHistory;
+    double camLatestTs;
+    double orbLatestTs;
+
   // Methods
   public:
-    Fuser();
-    ~Fuser();
-    void synchronizer(double, double, double, Pose, Pose, Pose&);
+    EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+    FuserT(int = W);
+    ~FuserT();
     bool fuse(Pose, Pose);
+    bool propagate(Pose, Pose&);
+    bool onCamPose(Pose, double, Pose&);
+    bool onOrbPose(Pose, double, Pose&);
+    void restartOrb();
+    void setMedianBudget(unsigned int, std::chrono::microseconds);
+    void setFilterWindow(int);
+    int getFilterWindow();
+    void setOutlierRejection(outlierRejection);
+    outlierRejection getOutlierRejection();
+    GatingStats getGatingStats();
+    MedianStats getOrbMedianStats();
+    MedianStats getFusedMedianStats();
     Pose getFusedPose();
+    double getFusedTimestamp();
 
     Pose getOrbPose();
     Pose getRecoveredPose();
@@ -72,8 +170,18 @@ class Fuser
   protected:
 
   private:
-    void sensorFusion(std::vector<double> &, std::vector<double> &);
-    Eigen::Quaterniond median_quaternions_weiszfeld(Eigen::MatrixXd, double, double, int);
+    void sensorFusion(const PoseVector &, const PoseVector &);
+    gatingResult gateOrbDelta(const PoseVector &, const PoseVector &);
+    void bufferPose(FixedRing<Pose, W> &, SlidingMedian<double> *, Pose &);
+    bool bufferReady(const FixedRing<Pose, W> &, const SlidingMedian<double> *);
+    void medianPose(const FixedRing<Pose, W> &, const SlidingMedian<double> *, MedianState &, Pose &);
+    Eigen::Vector3d medianTranslation(const FixedRing<Pose, W> &, const SlidingMedian<double> *);
+    Eigen::Quaterniond median_quaternions_weiszfeld(const QuaternionSamples &, MedianState &, double = 1, double = 0.0001);
 };
 
-#endif // __FUSER__
\ No newline at end of file
+// Sizes used by the perceptor node, instantiated in fuser.cc
+typedef FuserT<FILTER_WINDOW, RECOVERY_BUFFER> Fuser;
+
+extern template class FuserT<FILTER_WINDOW, RECOVERY_BUFFER>;
+
+#endif // __FUSER__
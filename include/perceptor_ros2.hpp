@@ -13,19 +13,34 @@
 #include <memory>
 #include <chrono>
 #include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include <rclcpp/rclcpp.hpp>
 #include <rmw/qos_profiles.h>
 #include <Eigen/Geometry>
 #include <cv_bridge/cv_bridge.h>
 #include <opencv2/core/core.hpp>
 #include <ORB_SLAM2/System.h>
-#include "realsense.hpp"
+#include "frameSource.hpp"
 #include "fuser.hpp"
+#include "slamSupervisor.hpp"
+#include "stageQueue.hpp"
+#include "stageSlot.hpp"
+#include "poseHistory.hpp"
+#include "posePredictor.hpp"
+#include "clockDomain.hpp"
 #include "pose.hpp"
 
 /* Node names. */
 #define PERCEPTORNAME "perceptor_node"
 
+/* Fused poses kept for lookups, ~2.5 s at the T265 rate. */
+#define POSE_HISTORY 512
+
+/* Largest distance of a mapped PX4 timestamp from the latest Timesync [us]. */
+#define PX4_MAX_SKEW 1000000.0
+
 /* PX4 messages. */
 #ifdef PX4
 #include <px4_msgs/msg/timesync.hpp>
@@ -34,36 +49,85 @@
 
 /* State messages. */
 #include <std_msgs/msg/int32.hpp>
+#include <std_msgs/msg/float64.hpp>
 #include <sensor_msgs/msg/point_cloud2.hpp>
 #include <visualization_msgs/msg/marker.hpp>
 
+/* Services. */
+#include "perceptor/srv/get_pose_at.hpp"
+
 /**
  * @brief Perceptor node: publishes pose estimates on ROS 2/PX4 topics, cloud points and images.
  */
 class PerceptorNode : public rclcpp::Node
 {
 public:
-  PerceptorNode(ORB_SLAM2::System *pSLAM, RealSense *realsense);
+  PerceptorNode();
+
+  void start(ORB_SLAM2::System *pSLAM, FrameSource *source, std::chrono::steady_clock::time_point startTime);
+  void stop(void);
 
   void poseConversion(const ORB_SLAM2::HPose &, const unsigned int, rs2_pose &);
   void poseConversion(const rs2_pose &, Pose &);
   void poseConversion(Pose &, rs2_pose &);
 
+  bool getPoseAt(rs2_time_t, Pose &);
+
 private:
-  void timer_vio_callback(void);
+  /* VIO pipeline items, passed between stages. */
+  struct CapturedFrames
+  {
+    FrameHandle irFrame, depthFrame;
+    rs2_pose pose;
+    rs2_time_t poseTs;
+  };
+
+  struct TrackedFrames
+  {
+    rs2_pose camPose, orbPose;
+    rs2_time_t irTs, poseTs;
+    bool orbRestart;  // ORB-SLAM2 tracking restarted, no previous ORB pose
+  };
+
+  struct FusedFrames
+  {
+    Pose fusedPose;
+    rs2_time_t fusedTs;
+    rs2_pose camPose;  // T265 sample the fused pose refers to
+    int32_t camAccuracy;
+  };
+
+  void startPipeline(void);
+  void stopPipeline(void);
+  void captureStage(void);
+  void trackingStage(void);
+  void fusionStage(void);
+  void publishStage(void);
+
+  void timer_pose_callback(void);
   void timer_pc_callback(void);
   void timer_rgb_callback(void);
 
-  rclcpp::CallbackGroup::SharedPtr vio_clbk_group_;
+  void publishFusedPose(Pose &, rs2_time_t, const rs2_pose &);
+
+  void get_pose_at_callback(const std::shared_ptr<perceptor::srv::GetPoseAt::Request> request,
+                            std::shared_ptr<perceptor::srv::GetPoseAt::Response> response);
+
+  rclcpp::CallbackGroup::SharedPtr pose_clbk_group_, service_clbk_group_;
 
-  rclcpp::TimerBase::SharedPtr vio_timer_, pc_timer_, rgb_timer_;
+  rclcpp::TimerBase::SharedPtr pose_timer_, pc_timer_, rgb_timer_;
 
   rclcpp::Publisher<std_msgs::msg::Int32>::SharedPtr state_publisher_;
   rclcpp::Publisher<sensor_msgs::msg::PointCloud2>::SharedPtr point_cloud_publisher_;
   rclcpp::Publisher<visualization_msgs::msg::Marker>::SharedPtr perceptor_pose_publisher_;
   rclcpp::Publisher<sensor_msgs::msg::Image>::SharedPtr rgb_frame_publisher_;
+  rclcpp::Publisher<std_msgs::msg::Float64>::SharedPtr latency_publisher_;
+
+  rclcpp::Service<perceptor::srv::GetPoseAt>::SharedPtr pose_at_service_;
 
   ORB_SLAM2::System *mpSLAM;
+  SlamSupervisor *supervisor;
+  bool slamRecovering;
   rs2_pose orbPose;
   vector<ORB_SLAM2::MapPoint*> pointCloud;
   int32_t perceptorState = Pose::trackQoS::LOST;
@@ -71,22 +135,45 @@ private:
 
   std::mutex pcMutex;
 
-  RealSense *realsense;
-  cv::Mat rgbMatrix;
+  FrameSource *source;
+  FrameHandle rgbFrame;
+  std::mutex rgbMutex;
 
   bool firstReset;
+  rs2_time_t poseResetTs = -1;  // T265 re-zero, tracking stage only
 
-  Pose orbPrevPose, camRecover;
-  rs2_time_t orbPrevTs;
+  Pose camRecover;
 
   Fuser *fuser;
+  std::mutex fuserMutex;
+  bool poseRateOutput;
+
+  PoseHistory<POSE_HISTORY> poseHistory;
+  rs2_pose camLatest;  // latest T265 sample fed to the fuser
+
+  PosePredictor predictor;
+  double maxPrediction;
 
   float camera_pitch;
   float cp_sin_, cp_cos_;
 
+  std::chrono::milliseconds pcPeriod, rgbPeriod;
+  DepthFilterConfig depthFilters;
+  std::string recordPath;
+
+  std::chrono::steady_clock::time_point startTime;
+  std::atomic<bool> firstPosePublished;
+
+  std::vector<std::thread> stages;
+  std::atomic<bool> pipelineRunning;
+  StageSlot<CapturedFrames> capturedSlot;  // latest wins: tracking skips stale framesets
+  StageQueue<TrackedFrames, 4> trackedQueue;
+  StageQueue<FusedFrames, 4> fusedQueue;
+
 #ifdef PX4
   void timestamp_callback(const px4_msgs::msg::Timesync::SharedPtr msg);
   std::atomic<uint64_t> timestamp_;
+  ClockDomain px4Clock;  // PX4 time base, fitted on Timesync samples
   rclcpp::CallbackGroup::SharedPtr timestamp_clbk_group_;
   rclcpp::Publisher<px4_msgs::msg::VehicleVisualOdometry>::SharedPtr vio_publisher_;
   rclcpp::Subscription<px4_msgs::msg::Timesync>::SharedPtr ts_sub_;
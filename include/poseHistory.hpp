@@ -0,0 +1,124 @@
+#ifndef __POSEHISTORY__
+#define __POSEHISTORY__
+
+#include <algorithm>
+#include <mutex>
+#include <Eigen/Geometry>
+#include "pose.hpp"
+#include "fixedRing.hpp"
+#include "poseInterpolator.hpp"
+
+// Thread-safe history of the last S fused poses, sorted by timestamp, for
+// lookups at arbitrary past times. Lookups find the samples around the
+// requested timestamp by binary search and interpolate between them (lerp
+// and slerp). A sample with the timestamp of the newest one replaces it
+// (e.g. the fused pose refining the propagated one), older samples are
+// ignored.
+template <int S>
+class PoseHistory {
+public:
+
+  struct Sample {
+    double timestamp;
+    Eigen::Vector3d translation;
+    Eigen::Quaterniond rotation;
+    unsigned int accuracy;
+  };
+
+  /* add(t, pose): appends a sample, dropping the oldest one if the history
+   * is full. Returns false if the sample is older than the newest one.
+   */
+  bool add(double t, Pose & pose)
+  {
+    Sample s;
+    s.timestamp   = t;
+    s.translation = pose.getTranslation();
+    s.rotation    = pose.getRotation();
+    s.accuracy    = pose.getAccuracy();
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const int n = m_history.size();
+    if (n > 0 && t <= m_history[n - 1].timestamp) {
+      if (t < m_history[n - 1].timestamp)
+        return false;
+      m_history[n - 1] = s;
+      return true;
+    }
+
+    m_history.push(s);
+    return true;
+  }
+
+  /* getPoseAt(t, pose): pose at timestamp t, interpolated between the two
+   * samples around it. Returns false if t is outside the history.
+   */
+  bool getPoseAt(double t, Pose & pose) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const int n = m_history.size();
+    if (n == 0 || t < m_history[0].timestamp || t > m_history[n - 1].timestamp)
+      return false;
+
+    // Last sample at or before t
+    int a = 0, b = n - 1;
+    while (b - a > 1) {
+      const int m = a + (b - a) / 2;
+      if (m_history[m].timestamp <= t)
+        a = m;
+      else
+        b = m;
+    }
+
+    const Sample & s0 = m_history[a];
+    const Sample & s1 = m_history[b];
+    if (t <= s0.timestamp || s1.timestamp <= s0.timestamp) {
+      setPose(s0, pose);
+      return true;
+    }
+    if (t >= s1.timestamp) {
+      setPose(s1, pose);
+      return true;
+    }
+
+    double u = (t - s0.timestamp) / (s1.timestamp - s0.timestamp);
+    pose.setTranslation(s0.translation + (s1.translation - s0.translation) * u);
+    pose.setRotation(PoseInterpolator<2>::slerp(s0.rotation, s1.rotation, u));
+    pose.setAccuracy(std::min(s0.accuracy, s1.accuracy));
+    return true;
+  }
+
+  /* getRange(t0, t1): timestamps of the oldest and newest samples, false if
+   * the history is empty
+   */
+  bool getRange(double & t0, double & t1) const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const int n = m_history.size();
+    if (n == 0)
+      return false;
+
+    t0 = m_history[0].timestamp;
+    t1 = m_history[n - 1].timestamp;
+    return true;
+  }
+
+  int size() const
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_history.size();
+  }
+
+private:
+
+  mutable std::mutex m_mutex;
+  FixedRing<Sample, S> m_history;
+
+  static void setPose(const Sample & s, Pose & pose)
+  {
+    pose.setTranslation(s.translation);
+    pose.setRotation(s.rotation);
+    pose.setAccuracy(s.accuracy);
+  }
+};
+
+#endif // __POSEHISTORY__
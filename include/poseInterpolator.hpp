@@ -0,0 +1,172 @@
+#ifndef __POSEINTERPOLATOR__
+#define __POSEINTERPOLATOR__
+
+#include <cmath>
+#include <Eigen/Geometry>
+#include "pose.hpp"
+#include "fixedRing.hpp"
+
+// Interpolates a pose at any timestamp from the last S timestamped samples,
+// with closed-form kernels: cubic Hermite for translation and squad for
+// rotation on the segment that contains the timestamp. Tangents, squad
+// control points and the rotation of each segment are computed once, when
+// the next sample is added, so that interpolating costs a few exp/log maps.
+// Timestamps before the oldest sample get the oldest pose, timestamps after
+// the newest one are extrapolated linearly (lerp and slerp) from the last two
+// samples. Samples must be added in increasing timestamp order.
+template <int S>
+class PoseInterpolator {
+  static_assert(S >= 2, "PoseInterpolator needs at least two samples");
+
+public:
+
+  struct Sample {
+    double timestamp;
+    Eigen::Vector3d translation;
+    Eigen::Quaterniond rotation;
+    Eigen::Vector3d tangent;    // translation velocity
+    Eigen::Quaterniond control; // squad inner control point
+    Eigen::Vector3d omega;      // log of the rotation to the next sample
+  };
+
+  /* add(t, pose): appends a sample, dropping the oldest one if the history
+   * is full. Rotations are kept in the hemisphere of the previous sample, and
+   * invalid ones (not unit) are replaced by the previous rotation.
+   */
+  void add(double t, Pose & pose)
+  {
+    Sample s;
+    s.timestamp   = t;
+    s.translation = pose.getTranslation();
+    s.rotation    = pose.getRotation();
+    s.tangent     = Eigen::Vector3d::Zero();
+    s.omega       = Eigen::Vector3d::Zero();
+
+    bool valid = std::abs(s.rotation.squaredNorm() - 1.0) < 1e-6;
+    const int n = m_history.size();
+    if (n > 0) {
+      Sample & prev = m_history[n - 1];
+      if (!valid)
+        s.rotation = prev.rotation;
+      else if (s.rotation.dot(prev.rotation) < 0)
+        s.rotation.coeffs() = -s.rotation.coeffs();
+
+      // The previous sample gets its right neighbour
+      double dt = t - prev.timestamp;
+      if (dt > 0)
+        s.tangent = (s.translation - prev.translation) / dt;
+      prev.omega = log(prev.rotation.conjugate() * s.rotation);
+      if (n > 1) {
+        const Sample & pprev = m_history[n - 2];
+        double dt2 = t - pprev.timestamp;
+        prev.tangent = (dt2 > 0) ? Eigen::Vector3d((s.translation - pprev.translation) / dt2) : s.tangent;
+        prev.control = prev.rotation * exp((pprev.omega - prev.omega) * 0.25);
+      } else {
+        prev.tangent = s.tangent;
+      }
+    } else if (!valid) {
+      s.rotation = Eigen::Quaterniond::Identity();
+    }
+    s.control = s.rotation;
+
+    m_history.push(s);
+  }
+
+  /* reset(): drops all the samples
+   */
+  void reset()
+  {
+    m_history = FixedRing<Sample, S>();
+  }
+
+  int size() const
+  {
+    return m_history.size();
+  }
+
+  /* interpolate(t, pose): pose at timestamp t, false if there are no
+   * samples. The accuracy of pose is left unchanged.
+   */
+  bool interpolate(double t, Pose & pose) const
+  {
+    const int n = m_history.size();
+    if (n == 0)
+      return false;
+
+    // Single sample, or before the oldest one
+    if (n == 1 || t <= m_history[0].timestamp) {
+      pose.setTranslation(m_history[0].translation);
+      pose.setRotation(m_history[0].rotation);
+      return true;
+    }
+
+    // Segment [i, i + 1] containing t, the last one when extrapolating
+    int i = n - 2;
+    while (i > 0 && t < m_history[i].timestamp)
+      i--;
+
+    const Sample & s0 = m_history[i];
+    const Sample & s1 = m_history[i + 1];
+    double dt = s1.timestamp - s0.timestamp;
+    if (dt <= 0) {
+      pose.setTranslation(s1.translation);
+      pose.setRotation(s1.rotation);
+      return true;
+    }
+
+    double u = (t - s0.timestamp) / dt;
+    if (u > 1.0) {
+      // Extrapolation: lerp and slerp
+      pose.setTranslation(s0.translation + (s1.translation - s0.translation) * u);
+      pose.setRotation(s0.rotation * exp(s0.omega * u));
+      return true;
+    }
+
+    // Cubic Hermite
+    double u2 = u * u, u3 = u2 * u;
+    pose.setTranslation((2 * u3 - 3 * u2 + 1) * s0.translation + (u3 - 2 * u2 + u) * dt * s0.tangent
+                      + (-2 * u3 + 3 * u2) * s1.translation + (u3 - u2) * dt * s1.tangent);
+
+    // Squad, which is a slerp for segments without neighbours
+    pose.setRotation(slerp(s0.rotation * exp(s0.omega * u), slerp(s0.control, s1.control, u), 2 * u * (1 - u)));
+    return true;
+  }
+
+  /* slerp(q0, q1, u): closed-form slerp along the shortest arc, u may be
+   * outside [0, 1] (extrapolation)
+   */
+  static Eigen::Quaterniond slerp(const Eigen::Quaterniond & q0, const Eigen::Quaterniond & q1, double u)
+  {
+    Eigen::Quaterniond d = q0.conjugate() * q1;
+    if (d.w() < 0)
+      d.coeffs() = -d.coeffs();
+    return q0 * exp(log(d) * u);
+  }
+
+private:
+
+  FixedRing<Sample, S> m_history;
+
+  /* log(q): logarithm of a unit quaternion, half the rotation vector
+   */
+  static Eigen::Vector3d log(const Eigen::Quaterniond & q)
+  {
+    double s = q.vec().norm();
+    if (s < 1e-12)
+      return q.vec();
+    return q.vec() * (std::atan2(s, q.w()) / s);
+  }
+
+  /* exp(v): inverse of log()
+   */
+  static Eigen::Quaterniond exp(const Eigen::Vector3d & v)
+  {
+    double a = v.norm();
+    if (a < 1e-12)
+      return Eigen::Quaterniond(1.0, v.x(), v.y(), v.z()).normalized();
+    double s = std::sin(a) / a;
+    return Eigen::Quaterniond(std::cos(a), v.x() * s, v.y() * s, v.z() * s);
+  }
+};
+
+#endif // __POSEINTERPOLATOR__
@@ -0,0 +1,39 @@
+#ifndef __POSEPREDICTOR__
+#define __POSEPREDICTOR__
+
+#include <Eigen/Geometry>
+#include <librealsense2/rs.hpp>
+#include "pose.hpp"
+
+// Predicts the fused pose forward to the publishing time, to compensate for
+// the capture, tracking and filtering latency. The pose is extrapolated at
+// constant linear and angular velocity. Velocities come from the T265
+// sample the fused pose was propagated or synchronized to: they are
+// expressed in the T265 reference frame, and are rotated into the fused
+// frame by the rotation between the two orientation estimates. Without a
+// tracked T265 sample, the linear velocity is the finite difference of the
+// last two fused poses and the angular velocity is zero.
+// Not thread-safe: update() and predict() must be called by one thread.
+class PosePredictor
+{
+  // Variables
+  private:
+    double maxHorizon; // [ms], no prediction beyond
+    bool valid;
+    Pose fused;
+    double fusedTs;
+    Eigen::Vector3d velocity;        // [m/s], fused frame
+    Eigen::Vector3d angularVelocity; // [rad/s], fused frame
+
+  // Methods
+  public:
+    PosePredictor(double = 100.0);
+    ~PosePredictor();
+    void setMaxHorizon(double);
+    void update(Pose, double, const rs2_pose &);
+    double predict(double, Pose &);
+    Eigen::Vector3d getVelocity();
+    Eigen::Vector3d getAngularVelocity();
+};
+
+#endif // __POSEPREDICTOR__
@@ -0,0 +1,59 @@
+#ifndef __SLAMSUPERVISOR__
+#define __SLAMSUPERVISOR__
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <ORB_SLAM2/System.h>
+#include "frameHandle.hpp"
+
+// Supervises ORB-SLAM2 resets and relocalization on a worker thread.
+// While TRACKING the SLAM system belongs to the caller, which tracks frames
+// itself. After requestReset() it belongs to the worker: the reset (done by
+// ORB-SLAM2 on the first tracked frame) and the re-initialization run on the
+// latest frames submitted, and tracking is handed back once it has been OK
+// for HEALTHY_FRAMES consecutive frames. The caller never waits meanwhile.
+class SlamSupervisor
+{
+  // Variables
+  public:
+    enum supervisorState {
+      TRACKING = 0,
+      RESETTING = 1,
+      RECOVERING = 2
+    };
+
+    static const unsigned int HEALTHY_FRAMES = 3;
+
+  private:
+    ORB_SLAM2::System *mpSLAM;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<int> state;
+    std::atomic<unsigned int> resets;
+
+    // Mailbox, only the latest frames are kept
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool resetRequested;
+    bool pending;
+    FrameHandle pendingIR, pendingDepth;
+
+  // Methods
+  public:
+    SlamSupervisor(ORB_SLAM2::System *);
+    ~SlamSupervisor();
+    void start();
+    void stop();
+    void requestReset();
+    void submit(const FrameHandle &, const FrameHandle &);
+    supervisorState getState();
+    bool isTracking();
+    unsigned int getResetCount();
+
+  private:
+    void loop();
+};
+
+#endif // __SLAMSUPERVISOR__
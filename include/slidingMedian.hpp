@@ -0,0 +1,201 @@
+#ifndef __SLIDINGMEDIAN__
+#define __SLIDINGMEDIAN__
+
+#include <vector>
+
+// Median of the last N samples, with N chosen at runtime. The window is kept
+// in a circular buffer and its samples are indexed by a max-heap (samples
+// below the median) and a min-heap (samples above it) sharing the median as
+// their root, so that adding a sample (and evicting the oldest one) costs
+// O(log N). Memory is only allocated by the constructor and by resize().
+// Like MedianFilter, with an even window the median is the upper one.
+template <typename T>
+class SlidingMedian {
+public:
+
+  /* Constructor
+   */
+  SlidingMedian(int window = 1)
+  {
+    resize(window);
+  }
+
+  /* resize(window): sets the window size and drops all the samples
+   */
+  void resize(int window)
+  {
+    m_n = window > 0 ? window : 1;
+    m_data.assign(m_n, T());
+    m_pos.assign(m_n, 0);
+    m_heapBuf.assign(m_n, 0);
+    m_heap = m_heapBuf.data() + m_n / 2;
+    reset();
+  }
+
+  /* reset(): drops all the samples
+   */
+  void reset()
+  {
+    m_idx = m_cnt = 0;
+
+    // Initial fill pattern: median, max, min, max, min...
+    for(int i = m_n - 1; i >= 0; i--){
+      m_pos[i] = ((i + 1) / 2) * ((i & 1) ? -1 : 1);
+      m_heap[m_pos[i]] = i;
+    }
+  }
+
+  /* addSample(s): adds the sample s to the window, replacing the oldest
+   * one if the window is full, and updates the median
+   */
+  void addSample(T s)
+  {
+    bool isNew = m_cnt < m_n;
+    int p = m_pos[m_idx];
+    T old = m_data[m_idx];
+    m_data[m_idx] = s;
+    m_idx = (m_idx + 1) % m_n;
+    if(isNew){
+      m_cnt++;
+    }
+
+    if(p > 0){
+      // Sample in the min-heap
+      if(!isNew && old < s){
+        p_minSortDown(p * 2);
+      } else if(p_minSortUp(p)){
+        p_maxSortDown(-1);
+      }
+    } else if(p < 0){
+      // Sample in the max-heap
+      if(!isNew && s < old){
+        p_maxSortDown(p * 2);
+      } else if(p_maxSortUp(p)){
+        p_minSortDown(1);
+      }
+    } else {
+      // Sample at the median
+      if(p_maxCt()){
+        p_maxSortDown(-1);
+      }
+      if(p_minCt()){
+        p_minSortDown(1);
+      }
+    }
+  }
+
+  /* getMedian(): returns the median of the samples in the window. Does not
+   * return anything meaningful if no sample has been added.
+   */
+  T getMedian() const
+  {
+    return m_data[m_heap[0]];
+  }
+
+  /* size(): number of samples in the window, up to window()
+   */
+  int size() const
+  {
+    return m_cnt;
+  }
+
+  int window() const
+  {
+    return m_n;
+  }
+
+  bool isReady() const
+  {
+    return m_cnt == m_n;
+  }
+
+private:
+
+  std::vector<T> m_data;      // circular buffer of samples
+  std::vector<int> m_pos;     // heap index of each sample
+  std::vector<int> m_heapBuf; // sample indices: max-heap, median, min-heap
+  int *m_heap;                // median, into m_heapBuf
+  int m_n, m_idx, m_cnt;
+
+  SlidingMedian(const SlidingMedian &) = delete;
+  SlidingMedian & operator=(const SlidingMedian &) = delete;
+
+  // Heap sizes, the min-heap holds one sample less with even counts
+  int p_minCt() const { return (m_cnt - 1) / 2; }
+  int p_maxCt() const { return m_cnt / 2; }
+
+  bool p_less(int i, int j) const
+  {
+    return m_data[m_heap[i]] < m_data[m_heap[j]];
+  }
+
+  /* p_cmpExch(i, j): swaps heap slots i and j if the first sample is the
+   * lower one, returns whether they were swapped
+   */
+  bool p_cmpExch(int i, int j)
+  {
+    if(!p_less(i, j)){
+      return false;
+    }
+    int t = m_heap[i];
+    m_heap[i] = m_heap[j];
+    m_heap[j] = t;
+    m_pos[m_heap[i]] = i;
+    m_pos[m_heap[j]] = j;
+    return true;
+  }
+
+  /* p_minSortDown(i): restores the min-heap from slot i down, slot 1 being
+   * compared to the median
+   */
+  void p_minSortDown(int i)
+  {
+    for(; i <= p_minCt(); i *= 2){
+      if(i > 1 && i < p_minCt() && p_less(i + 1, i)){
+        ++i;
+      }
+      if(!p_cmpExch(i, i / 2)){
+        break;
+      }
+    }
+  }
+
+  /* p_maxSortDown(i): restores the max-heap (negative slots) from slot i
+   * down, slot -1 being compared to the median
+   */
+  void p_maxSortDown(int i)
+  {
+    for(; i >= -p_maxCt(); i *= 2){
+      if(i < -1 && i > -p_maxCt() && p_less(i, i - 1)){
+        --i;
+      }
+      if(!p_cmpExch(i / 2, i)){
+        break;
+      }
+    }
+  }
+
+  /* p_minSortUp(i): restores the min-heap above slot i, median included.
+   * Returns true if the sample reached the median.
+   */
+  bool p_minSortUp(int i)
+  {
+    while(i > 0 && p_cmpExch(i, i / 2)){
+      i /= 2;
+    }
+    return i == 0;
+  }
+
+  /* p_maxSortUp(i): restores the max-heap above slot i, median included.
+   * Returns true if the sample reached the median.
+   */
+  bool p_maxSortUp(int i)
+  {
+    while(i < 0 && p_cmpExch(i / 2, i)){
+      i /= 2;
+    }
+    return i == 0;
+  }
+};
+
+#endif // __SLIDINGMEDIAN__
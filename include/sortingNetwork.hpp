@@ -0,0 +1,109 @@
+#ifndef __SORTINGNETWORK__
+#define __SORTINGNETWORK__
+
+#include <algorithm>
+#include <type_traits>
+
+// Median of a small fixed window with a sorting network generated at compile
+// time: Batcher's odd-even merge sort of N wires, pruned to the comparators
+// the median wire depends on. The network is unrolled with constant wire
+// indices and is branch-free, so it can process several channels at once
+// when samples are Eigen arrays (one channel per coefficient): each
+// comparator is then a vector min/max pair. With an even window the median
+// is the upper one, like MedianFilter and SlidingMedian.
+template <int N>
+struct MedianNetwork {
+  static_assert(N >= 1 && N <= 32, "MedianNetwork window must be in [1, 32]");
+
+  static constexpr int MAX = N * N; // comparators upper bound
+  int a[MAX], b[MAX];               // comparators, min to a and max to b
+  int size;
+
+  /* Constructor: generates and prunes the network
+   */
+  constexpr MedianNetwork()
+  : a(), b(), size(0)
+  {
+    int sa[MAX] = {}, sb[MAX] = {}, count = 0;
+
+    // Batcher's odd-even merge sort, for any N
+    for (int p = 1; p < N; p += p) {
+      for (int k = p; k >= 1; k /= 2) {
+        for (int j = k % p; j <= N - 1 - k; j += 2 * k) {
+          for (int i = 0; i <= std::min(k - 1, N - j - k - 1); i++) {
+            if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+              sa[count] = i + j;
+              sb[count] = i + j + k;
+              count++;
+            }
+          }
+        }
+      }
+    }
+
+    // Backwards from the median wire, keep the comparators it depends on
+    bool needed[N] = {};
+    bool kept[MAX] = {};
+    needed[N / 2] = true;
+    for (int c = count - 1; c >= 0; c--) {
+      if (needed[sa[c]] || needed[sb[c]]) {
+        kept[c] = true;
+        needed[sa[c]] = needed[sb[c]] = true;
+      }
+    }
+
+    for (int c = 0; c < count; c++) {
+      if (kept[c]) {
+        a[size] = sa[c];
+        b[size] = sb[c];
+        size++;
+      }
+    }
+  }
+};
+
+template <int N>
+constexpr MedianNetwork<N> medianNetwork = MedianNetwork<N>();
+
+/* networkCmpExch(lo, hi): comparator for scalars
+ */
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value>::type networkCmpExch(T & lo, T & hi)
+{
+  T t = std::min(lo, hi);
+  hi = std::max(lo, hi);
+  lo = t;
+}
+
+/* networkCmpExch(lo, hi): comparator for Eigen arrays, coefficient-wise
+ */
+template <typename T>
+inline typename std::enable_if<!std::is_arithmetic<T>::value>::type networkCmpExch(T & lo, T & hi)
+{
+  T t = lo.min(hi);
+  hi = lo.max(hi);
+  lo = t;
+}
+
+template <int N, int I, typename T>
+inline void p_networkApply(T *, std::false_type)
+{
+}
+
+template <int N, int I, typename T>
+inline void p_networkApply(T * v, std::true_type)
+{
+  networkCmpExch(v[medianNetwork<N>.a[I]], v[medianNetwork<N>.b[I]]);
+  p_networkApply<N, I + 1>(v, std::integral_constant<bool, (I + 1 < medianNetwork<N>.size)>());
+}
+
+/* networkMedian(v): median of the N samples in v, which are reordered
+ */
+template <int N, typename T>
+inline T networkMedian(T (&v)[N])
+{
+  p_networkApply<N, 0>(v, std::integral_constant<bool, (0 < medianNetwork<N>.size)>());
+  return v[N / 2];
+}
+
+#endif // __SORTINGNETWORK__
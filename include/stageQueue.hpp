@@ -0,0 +1,73 @@
+#ifndef __STAGEQUEUE__
+#define __STAGEQUEUE__
+
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include "spscRing.hpp"
+
+// Bounded queue between two pipeline stages: a lock-free SpscRing carries
+// the items, and a condition variable lets the consumer sleep while the ring
+// is empty. The producer never blocks: when the consumer stage falls behind
+// new items are dropped (see dropped()).
+template <typename T, size_t S>
+class StageQueue {
+
+public:
+
+  /* push(v): producer side, appends v and wakes the consumer. Returns false
+   * if the queue is full and v was dropped.
+   */
+  bool push(const T & v)
+  {
+    if (!m_ring.push(v))
+      return false;
+
+    // Taking the lock orders the push with the consumer emptiness check
+    { std::lock_guard<std::mutex> lock(m_mtx); }
+    m_cv.notify_one();
+    return true;
+  }
+
+  /* pop(v, timeout): consumer side, waits up to timeout for an item.
+   * Returns false on timeout or after wake().
+   */
+  template <typename Rep, typename Period>
+  bool pop(T & v, const std::chrono::duration<Rep, Period> & timeout)
+  {
+    if (m_ring.pop(v))
+      return true;
+
+    std::unique_lock<std::mutex> lock(m_mtx);
+    m_cv.wait_for(lock, timeout, [this] { return !m_ring.empty() || m_woken; });
+    m_woken = false;
+    return m_ring.pop(v);
+  }
+
+  /* wake(): releases a waiting consumer, e.g. when the pipeline stops.
+   */
+  void wake()
+  {
+    { std::lock_guard<std::mutex> lock(m_mtx); m_woken = true; }
+    m_cv.notify_one();
+  }
+
+  size_t size() const
+  {
+    return m_ring.size();
+  }
+
+  size_t dropped() const
+  {
+    return m_ring.dropped();
+  }
+
+private:
+
+  SpscRing<T, S> m_ring;
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  bool m_woken = false;
+};
+
+#endif // __STAGEQUEUE__
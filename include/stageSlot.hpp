@@ -0,0 +1,81 @@
+#ifndef __STAGESLOT__
+#define __STAGESLOT__
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include "tripleBuffer.hpp"
+
+// Latest-wins handoff between two pipeline stages: a lock-free TripleBuffer
+// carries the item, and a condition variable lets the consumer sleep until
+// a new one is published. The producer never blocks and a new item replaces
+// the one the consumer has not taken yet, so a slow consumer always gets the
+// freshest item instead of a stale backlog (see dropped()).
+template <typename T>
+class StageSlot {
+
+public:
+
+  /* push(v): producer side, publishes v and wakes the consumer. Returns
+   * false if v replaced an item that was not consumed yet.
+   */
+  bool push(const T & v)
+  {
+    bool replaced = m_buffer.hasUpdate();
+    m_buffer.publish(v);
+    if (replaced)
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+
+    // Taking the lock orders the publish with the consumer update check
+    { std::lock_guard<std::mutex> lock(m_mtx); }
+    m_cv.notify_one();
+    return !replaced;
+  }
+
+  /* pop(v, timeout): consumer side, waits up to timeout for a new item.
+   * Returns false on timeout or after wake().
+   */
+  template <typename Rep, typename Period>
+  bool pop(T & v, const std::chrono::duration<Rep, Period> & timeout)
+  {
+    if (!m_buffer.update()) {
+      std::unique_lock<std::mutex> lock(m_mtx);
+      m_cv.wait_for(lock, timeout, [this] { return m_buffer.hasUpdate() || m_woken; });
+      m_woken = false;
+      lock.unlock();
+      if (!m_buffer.update())
+        return false;
+    }
+
+    v = m_buffer.read();
+    return true;
+  }
+
+  /* wake(): releases a waiting consumer, e.g. when the pipeline stops.
+   */
+  void wake()
+  {
+    { std::lock_guard<std::mutex> lock(m_mtx); m_woken = true; }
+    m_cv.notify_one();
+  }
+
+  /* dropped(): items replaced before the consumer took them. A replacement
+   * racing with the consumer update may be counted although the item was
+   * taken, so this is an upper bound.
+   */
+  size_t dropped() const
+  {
+    return m_dropped.load(std::memory_order_relaxed);
+  }
+
+private:
+
+  TripleBuffer<T> m_buffer;
+  std::atomic<size_t> m_dropped{0};
+  std::mutex m_mtx;
+  std::condition_variable m_cv;
+  bool m_woken = false;
+};
+
+#endif // __STAGESLOT__
@@ -11,7 +11,18 @@ def generate_launch_description():
           {'perception_radius': 1.0},
           {'camera_pitch': 0.0},
           {'point_cloud_period': 1000},
-          {'rgb_frame_period': 300}
+          {'rgb_frame_period': 300},
+          {'pose_rate_output': True},
+          {'record_path': ''},
+          {'depth_decimation': 1},
+          {'depth_min_distance': 0.0},
+          {'depth_max_distance': 0.0},
+          {'depth_spatial_filter': False},
+          {'depth_temporal_filter': False},
+          {'depth_hole_filling': -1},
+          {'prediction_max_horizon': 100.0},
+          {'outlier_rejection': 'median'},
+          {'filter_window': 6}
         ],
         output='both',
         emulate_tty=True,
@@ -1,30 +1,5 @@
 #include "fuser.hpp"
 
-class SplineInterpolator {
-  public:
-    SplineInterpolator(Eigen::Vector2d const &x_vec, Eigen::Vector2d const &y_vec): x_min(x_vec.minCoeff()), x_max(x_vec.maxCoeff()),
-      spline_(Eigen::SplineFitting<Eigen::Spline<double, 1>>::Interpolate(y_vec.transpose(), std::min<int>(x_vec.rows() - 1, 3), scaled_values(x_vec)))
-    {}
-
-    double operator()(double x) const {
-      return spline_(scaled_value(x))(0);
-    }
-
-  private:
-    double scaled_value(double x) const {
-      return (x - x_min) / (x_max - x_min);
-    }
-
-    Eigen::RowVectorXd scaled_values(Eigen::VectorXd const &x_vec) const {
-      return x_vec.unaryExpr([this](double x) { return scaled_value(x); }).transpose();
-    }
-
-    double x_min;
-    double x_max;
-
-    Eigen::Spline<double, 1> spline_;
-};
-
 static inline void t_qfix(Eigen::Quaterniond &q) {
  if (q.w() < 0)  {
   q.w() = -q.w();
@@ -34,13 +9,15 @@ static inline void t_qfix(Eigen::Quaterniond &q) {
  }
 }
 
-Eigen::Vector4d avg_quaternion_markley(Eigen::MatrixXd Q) {
+// Quaternions are assumed to be stored in columns!
+template <int N>
+static Eigen::Vector4d avg_quaternion_markley(const Eigen::Matrix<double, 4, N> & Q) {
     Eigen::Matrix4d A = Eigen::Matrix4d::Zero();
-    int M = Q.rows();
+    int M = Q.cols();
 
     for(int i=0; i<M; i++)
     {
-      Eigen::Vector4d q = Q.row(i);
+      Eigen::Vector4d q = Q.col(i);
       if (q[0]<0)
         q = -q;
       A = q*q.adjoint() + A;
@@ -48,40 +25,96 @@ Eigen::Vector4d avg_quaternion_markley(Eigen::MatrixXd Q) {
 
     A = (1.0/M)*A;
 
-    Eigen::SelfAdjointEigenSolver<Eigen::MatrixXd> eig(A);
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix4d> eig(A);
     Eigen::Vector4d qavg = eig.eigenvectors().col(3);
     return qavg;
 }
 
 // Quaternions are assumed to be stored in columns!
-Eigen::Quaterniond Fuser::median_quaternions_weiszfeld(Eigen::MatrixXd Q, double p = 1, double maxAngularUpdate = 0.0001, int maxIterations = 1000) {
-  Eigen::Matrix4d A = Eigen::Matrix4d::Zero();
-  int M = Q.cols();
-  Eigen::Vector4d st = avg_quaternion_markley(Q.transpose());
-  Eigen::Quaterniond qMedian(st[0], st[1], st[2], st[3]);
+// Starts from the median of the previous window, which shares all the
+// samples but the newest one, if it is still close to them (Markley average
+// otherwise). If all the samples are within MEDIAN_SMALL_ANGLE of the start,
+// their normalized mean is returned: the error is bounded by that angle.
+// Iterations stop when the update is below maxAngularUpdate or when the
+// iteration or time budget runs out.
+template <int W, int R>
+Eigen::Quaterniond FuserT<W, R>::median_quaternions_weiszfeld(const QuaternionSamples & Q, MedianState & state, double p, double maxAngularUpdate) {
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+  const int M = Q.cols();
   const double epsAngle = 0.0000001;
   maxAngularUpdate = std::max(maxAngularUpdate, epsAngle);
+  const double coincidentAngle = 10 * maxAngularUpdate;
+
+  state.stats.iterations = 0;
+  state.stats.fastPath   = false;
+  state.stats.converged  = true;
+
+  Eigen::Vector4d st;
+  if (state.valid)
+    st << state.median.w(), state.median.x(), state.median.y(), state.median.z();
+  if (!state.valid || std::abs(st.dot(Q.col(M - 1))) < cos(MEDIAN_WARM_START_ANGLE * 0.5))
+    st = avg_quaternion_markley(Q);
+  Eigen::Quaterniond qMedian(st[0], st[1], st[2], st[3]);
+
+  // Fast path, samples sign-aligned to the start
+  Eigen::Vector4d sum = Eigen::Vector4d::Zero();
+  double minDot = 1.0;
+  for (int j = 0; j < M; j++) {
+    Eigen::Vector4d q = Q.col(j);
+    double d = q.dot(st);
+    if (d < 0) {
+      q = -q;
+      d = -d;
+    }
+    sum += q;
+    minDot = std::min(minDot, d);
+  }
+
+  if (minDot >= cos(MEDIAN_SMALL_ANGLE * 0.5)) {
+    sum.normalize();
+    qMedian = Eigen::Quaterniond(sum[0], sum[1], sum[2], sum[3]);
+    t_qfix(qMedian);
+    state.median = qMedian;
+    state.valid = true;
+    state.stats.fastPath = true;
+    return qMedian;
+  }
+
   double theta = 10 * maxAngularUpdate;
-  int i = 0;
 
-  while (theta > maxAngularUpdate && i <= maxIterations) {
+  while (theta > maxAngularUpdate) {
+    if (state.stats.iterations >= medianMaxIterations || std::chrono::steady_clock::now() - t0 > medianTimeBudget) {
+      state.stats.converged = false;
+      break;
+    }
+
     Eigen::Vector3d delta(0,0,0);
     double weightSum = 0;
+    int coincident = 0;
     for (int j = 0; j < M; j++) {
       Eigen::Vector4d q = Q.col(j);
       Eigen::Quaterniond qj = Eigen::Quaterniond(q[0], q[1], q[2], q[3])*(qMedian.conjugate());
-      double theta = 2 * acos(qj.w());
-      if (theta > epsAngle) {
-        Eigen::Vector3d axisAngle = qj.vec() / sin(theta / 2);
-        axisAngle *= theta;
-        double weight = 1.0 / pow(theta, 2 - p);
-        delta += weight * axisAngle;
+      t_qfix(qj);
+      double s = qj.vec().norm();
+      double angle = 2 * atan2(s, qj.w());
+      if (angle > coincidentAngle) {
+        // Axis-angle weighted by angle^(p - 2), the angle cancels out for p = 1
+        double weight = (p == 1) ? 1.0 / angle : pow(angle, p - 2);
+        delta += (weight * angle / s) * qj.vec();
         weightSum += weight;
+      } else {
+        coincident++;
       }
     }
 
     if (weightSum > epsAngle) {
+      // Vardi-Zhang step: the estimate can sit on a sample (e.g. the warm
+      // start), where the plain Weiszfeld step vanishes. Samples closer than
+      // coincidentAngle are handled as coincident.
+      double pull = delta.norm();
       delta /= weightSum;
+      if (coincident > 0)
+        delta *= std::max(0.0, 1.0 - coincident / pull);
       theta = delta.norm();
       if (theta > epsAngle) {
         double stby2 = sin(theta*0.5);
@@ -94,17 +127,20 @@ Eigen::Quaterniond Fuser::median_quaternions_weiszfeld(Eigen::MatrixXd Q, double
       theta = 0;
     }
 
-    i++;
+    state.stats.iterations++;
   }
 
+  state.median = qMedian;
+  state.valid = true;
   return qMedian;
 }
 
-Fuser::Fuser(): REDUCTION_FACTOR(0.01), recovered(false), firstRecover(true), medianFilterReady(false), fuserStatus(UNINITIALIZED), orbQoS(LOST), camQoS(LOST), alphaBlending(0.75), alphaWeight(0.7), counter(0)
+template <int W, int R>
+FuserT<W, R>::FuserT(int _filterWindow): REDUCTION_FACTOR(0.01), recovered(false), firstRecover(true), medianFilterReady(false), fuserStatus(UNINITIALIZED), orbQoS(LOST), camQoS(LOST), alphaBlending(0.75), alphaWeight(0.7), counter(0), medianMaxIterations(MEDIAN_MAX_ITERATIONS), medianTimeBudget(MEDIAN_TIME_BUDGET_US), rejectionMode(MEDIAN), gatingSamples(0), gatingConsecutive(0), camLatestTs(-1), orbLatestTs(-1)
 {
-  recoverSteps = FILTER_WINDOW + 1;
-  deltaCamVO.reserve(pose.getPoseElements());
-  deltaOrbVO.reserve(pose.getPoseElements());
+  setFilterWindow(_filterWindow);
+  deltaCamVO.setZero();
+  deltaOrbVO.setZero();
   pose.setTranslation(0.0,0.0,0.0);
   pose.setRotation(1.0,0.0,0.0,0.0);
   posePrev.setTranslation(0.0,0.0,0.0);
@@ -115,77 +151,59 @@ Fuser::Fuser(): REDUCTION_FACTOR(0.01), recovered(false), firstRecover(true), me
   poseFilteredPrev.setRotation(1.0,0.0,0.0,0.0);
   camRecover.setTranslation(0.0,0.0,0.0);
   camRecover.setRotation(1.0,0.0,0.0,0.0);
-  orbQoSPrev.reserve(RECOVERY_BUFFER);
-  orbQoSFilterReset.reserve(FILTER_WINDOW);
+  orbMedian.valid = false;
+  poseMedian.valid = false;
+  orbMedian.stats = poseMedian.stats = MedianStats{0, false, true};
+  gatingCovariance.setZero();
+  gatingStats = GatingStats{0.0, false, 0};
 }
 
-Fuser::~Fuser()
+template <int W, int R>
+FuserT<W, R>::~FuserT()
 {}
 
-// This function synchronizes a sample s3 on the basis of two
-// previous samples (s1, s2) at timestep timestep3.
-void Fuser::synchronizer(double timestep1, double timestep2, double timestep3, Pose s1, Pose s2, Pose & s3)
+template <int W, int R>
+Pose FuserT<W, R>::getFusedPose()
 {
-  // This is used to initialize
-  if (timestep1 == -1)
-    s3 = s2;
-  else if (timestep3 < timestep1)
-    s3 = s1;
-  else if ((timestep3 < timestep2) || (timestep1 == timestep2))
-    s3 = s2;
-  else {
-    Eigen::Vector2d tvals = {timestep1, timestep2};
-    Eigen::Vector2d Xvals = {s1.getTranslation()(0), s2.getTranslation()(0)};
-    Eigen::Vector2d Yvals = {s1.getTranslation()(1), s2.getTranslation()(1)};
-    Eigen::Vector2d Zvals = {s1.getTranslation()(2), s2.getTranslation()(2)};
-    SplineInterpolator sX(tvals, Xvals), sY(tvals, Yvals), sZ(tvals, Zvals);
-
-    s3.setTranslation(sX(timestep3), sY(timestep3), sZ(timestep3));
-
-    if (s1.getRotation().w() != 0.0 && s2.getRotation().w() != 0.0 && s1.getRotation().x() != 0.0 && s2.getRotation().x() != 0.0 && s1.getRotation().y() != 0.0 && s2.getRotation().y() != 0.0 && s1.getRotation().z() != 0.0 && s2.getRotation().z() != 0.0)
-    {
-      double dt = (timestep3 - timestep1)/(timestep2 - timestep1);
-      Eigen::Quaterniond rotation = s2.getRotation() * s1.getRotation().inverse();
-      Eigen::AngleAxisd rotAA(rotation);
-      if (rotAA.angle() > M_PI)
-        rotAA.angle() -= 2*M_PI;
-      rotAA.angle() = std::fmod(rotAA.angle() * dt, 2*M_PI);
-      Eigen::Quaterniond s3quat(Eigen::AngleAxisd(rotAA.angle(), rotAA.axis()));
-      s3.setRotation(s3quat * s1.getRotation());
-    }
-  }
-
-  return;
+  return(poseFiltered);
 }
 
-Pose Fuser::getFusedPose()
+// Timestamp of the latest fused pose: the T265 sample it was propagated or
+// synchronized to.
+template <int W, int R>
+double FuserT<W, R>::getFusedTimestamp()
 {
-  return(poseFiltered);
+  return(camLatestTs);
 }
 
 // Debugging purpose only
-Pose Fuser::getOrbPose()
+template <int W, int R>
+Pose FuserT<W, R>::getOrbPose()
 {
   return(orbPose);
 }
 
-Pose Fuser::getRecoveredPose()
+template <int W, int R>
+Pose FuserT<W, R>::getRecoveredPose()
 {
   return(camRecover);
 }
 
-Pose Fuser::getdeltaVOPose()
+template <int W, int R>
+Pose FuserT<W, R>::getdeltaVOPose()
 {
   return(deltaVO);
 }
 
-Pose Fuser::getdeltaORBPose()
+template <int W, int R>
+Pose FuserT<W, R>::getdeltaORBPose()
 {
   return(deltaORB);
 }
 // ...Debugging purpose only
 
-bool Fuser::fuse(Pose camVO, Pose orbVO)
+template <int W, int R>
+bool FuserT<W, R>::fuse(Pose camVO, Pose orbVO)
 {
   Pose _orbPose          = orbVO;
   camQoS                 = camVO.getAccuracy();
@@ -198,16 +216,16 @@ bool Fuser::fuse(Pose camVO, Pose orbVO)
 
   // Recover after an ORB fault, must re-initialize the ORB trajectory with
   // the corrected roto-translation.
-  if (counter > RECOVERY_BUFFER) {
+  if (counter > R) {
     if ((orbQoS == OK) && (orbQoSPrev[0] == LOST)) {
       unsigned int okCounter = 0;
-      for (unsigned int i = 1; i < RECOVERY_BUFFER; i++) {
+      for (unsigned int i = 1; i < R; i++) {
         if (orbQoSPrev[i] == OK) {
           okCounter++;
         }
       }
 
-      if (okCounter == RECOVERY_BUFFER - 1) {
+      if (okCounter == R - 1) {
         recovered = true;
         firstRecover = true;
         camRecover = poseFilteredPrev;
@@ -217,7 +235,7 @@ bool Fuser::fuse(Pose camVO, Pose orbVO)
 
     // This prevents including wrong ORB measurements before computing the
     // corrected ORB trajectory.
-    for (unsigned int i = 1; i < RECOVERY_BUFFER; i++) {
+    for (unsigned int i = 1; i < R; i++) {
       if (orbQoSPrev[i] == LOST) {
         orbQoS = LOST;
         recovered = false;
@@ -241,123 +259,60 @@ bool Fuser::fuse(Pose camVO, Pose orbVO)
     _orbPose.rotoTranslation(firstCamVO.getTranslation(), firstCamVO.getRotation());
   }
 
-  // Filtering orb Pose
-  if (medianFilterReady) {
+  // Filtering orb Pose. The buffers are filled in both modes, so that the
+  // outlier rejection can be switched at any time.
+  bufferPose(orbPoseBuffer, orbFilters, _orbPose);
+  if (rejectionMode == GATING) {
+    // Spikes are gated on the deltas below
+  } else if (medianFilterReady) {
     // Filtering orb spikes with median filter
-    std::vector<MedianFilter<double, FILTER_WINDOW>> orbFilters(pose.getPoseElements());
-    Eigen::MatrixXd qSamples(4,FILTER_WINDOW);
-
-    for (unsigned int j = 0; j < FILTER_WINDOW - 1; j++) {
-      orbPoseBuffer[j] = orbPoseBuffer[j+1];
-
-      // Fill the median filters buffers
-      orbFilters[Pose::X].addSample(orbPoseBuffer[j].getTranslation()[Pose::X]);
-      orbFilters[Pose::Y].addSample(orbPoseBuffer[j].getTranslation()[Pose::Y]);
-      orbFilters[Pose::Z].addSample(orbPoseBuffer[j].getTranslation()[Pose::Z]);
-      qSamples(0,j) = orbPoseBuffer[j].getRotation().w();
-      qSamples(1,j) = orbPoseBuffer[j].getRotation().x();
-      qSamples(2,j) = orbPoseBuffer[j].getRotation().y();
-      qSamples(3,j) = orbPoseBuffer[j].getRotation().z();
-    }
-    orbPoseBuffer[FILTER_WINDOW-1] = _orbPose;
-    orbFilters[Pose::X].addSample(orbPoseBuffer[FILTER_WINDOW-1].getTranslation()[Pose::X]);
-    orbFilters[Pose::Y].addSample(orbPoseBuffer[FILTER_WINDOW-1].getTranslation()[Pose::Y]);
-    orbFilters[Pose::Z].addSample(orbPoseBuffer[FILTER_WINDOW-1].getTranslation()[Pose::Z]);
-    qSamples(0,FILTER_WINDOW-1) = orbPoseBuffer[FILTER_WINDOW-1].getRotation().w();
-    qSamples(1,FILTER_WINDOW-1) = orbPoseBuffer[FILTER_WINDOW-1].getRotation().x();
-    qSamples(2,FILTER_WINDOW-1) = orbPoseBuffer[FILTER_WINDOW-1].getRotation().y();
-    qSamples(3,FILTER_WINDOW-1) = orbPoseBuffer[FILTER_WINDOW-1].getRotation().z();
-
-    _orbPose.setTranslation(orbFilters[Pose::X].getMedian(), orbFilters[Pose::Y].getMedian(), orbFilters[Pose::Z].getMedian());
-    _orbPose.setRotation(median_quaternions_weiszfeld(qSamples));
-  } else {
-    orbPoseBuffer.push_back(_orbPose);
-    if (orbPoseBuffer.size() == FILTER_WINDOW)
-      medianFilterReady = true;
+    medianPose(orbPoseBuffer, orbFilters, orbMedian, _orbPose);
+  } else if (bufferReady(orbPoseBuffer, orbFilters)) {
+    medianFilterReady = true;
   }
 
   orbVO = _orbPose;
 
   if (fuserStatus == UNINITIALIZED) {
-    deltaCamVO[Pose::X]  = camVO.getTranslation()[Pose::X];
-    deltaCamVO[Pose::Y]  = camVO.getTranslation()[Pose::Y];
-    deltaCamVO[Pose::Z]  = camVO.getTranslation()[Pose::Z];
-    deltaCamVO[Pose::WQ] = camVO.getRotation().w() - 1.0;
-    deltaCamVO[Pose::XQ] = camVO.getRotation().x();
-    deltaCamVO[Pose::YQ] = camVO.getRotation().y();
-    deltaCamVO[Pose::ZQ] = camVO.getRotation().z();
-
-    deltaOrbVO[Pose::X]  = orbVO.getTranslation()[Pose::X];
-    deltaOrbVO[Pose::Y]  = orbVO.getTranslation()[Pose::Y];
-    deltaOrbVO[Pose::Z]  = orbVO.getTranslation()[Pose::Z];
-    deltaOrbVO[Pose::WQ] = orbVO.getRotation().w() - 1.0;
-    deltaOrbVO[Pose::XQ] = orbVO.getRotation().x();
-    deltaOrbVO[Pose::YQ] = orbVO.getRotation().y();
-    deltaOrbVO[Pose::ZQ] = orbVO.getRotation().z();
+    deltaCamVO << camVO.getTranslation(), camVO.getRotation().w() - 1.0, camVO.getRotation().vec();
+    deltaOrbVO << orbVO.getTranslation(), orbVO.getRotation().w() - 1.0, orbVO.getRotation().vec();
   } else {
-    deltaCamVO[Pose::X]  = camVO.getTranslation()[Pose::X] - camVOPrev.getTranslation()[Pose::X];
-    deltaCamVO[Pose::Y]  = camVO.getTranslation()[Pose::Y] - camVOPrev.getTranslation()[Pose::Y];
-    deltaCamVO[Pose::Z]  = camVO.getTranslation()[Pose::Z] - camVOPrev.getTranslation()[Pose::Z];
-    deltaCamVO[Pose::WQ] = camVO.getRotation().w() - camVOPrev.getRotation().w();
-    deltaCamVO[Pose::XQ] = camVO.getRotation().x() - camVOPrev.getRotation().x();
-    deltaCamVO[Pose::YQ] = camVO.getRotation().y() - camVOPrev.getRotation().y();
-    deltaCamVO[Pose::ZQ] = camVO.getRotation().z() - camVOPrev.getRotation().z();
-
-    deltaOrbVO[Pose::X]  = orbVO.getTranslation()[Pose::X] - orbVOPrev.getTranslation()[Pose::X];
-    deltaOrbVO[Pose::Y]  = orbVO.getTranslation()[Pose::Y] - orbVOPrev.getTranslation()[Pose::Y];
-    deltaOrbVO[Pose::Z]  = orbVO.getTranslation()[Pose::Z] - orbVOPrev.getTranslation()[Pose::Z];
-    deltaOrbVO[Pose::WQ] = orbVO.getRotation().w() - orbVOPrev.getRotation().w();
-    deltaOrbVO[Pose::XQ] = orbVO.getRotation().x() - orbVOPrev.getRotation().x();
-    deltaOrbVO[Pose::YQ] = orbVO.getRotation().y() - orbVOPrev.getRotation().y();
-    deltaOrbVO[Pose::ZQ] = orbVO.getRotation().z() - orbVOPrev.getRotation().z();
+    deltaCamVO << camVO.getTranslation() - camVOPrev.getTranslation(), camVO.getRotation().w() - camVOPrev.getRotation().w(), camVO.getRotation().vec() - camVOPrev.getRotation().vec();
+    deltaOrbVO << orbVO.getTranslation() - orbVOPrev.getTranslation(), orbVO.getRotation().w() - orbVOPrev.getRotation().w(), orbVO.getRotation().vec() - orbVOPrev.getRotation().vec();
+
+    // Gating orb spikes: a rejected ORB delta is replaced by the T265 one,
+    // and the ORB pose by its prediction, so that the next delta is not
+    // affected by the spike.
+    if (rejectionMode == GATING && orbQoS != LOST) {
+      gatingResult result = gateOrbDelta(deltaCamVO, deltaOrbVO);
+      if (result != GATE_ACCEPT) {
+        deltaOrbVO = deltaCamVO;
+        if (result == GATE_REJECT) {
+          orbVO.setTranslation(orbVOPrev.getTranslation() + deltaCamVO.template head<3>());
+          orbVO.setRotation(orbVOPrev.getRotation().w() + deltaCamVO[Pose::WQ], orbVOPrev.getRotation().x() + deltaCamVO[Pose::XQ], orbVOPrev.getRotation().y() + deltaCamVO[Pose::YQ], orbVOPrev.getRotation().z() + deltaCamVO[Pose::ZQ]);
+        }
+      }
+    }
   }
 
   sensorFusion(deltaCamVO, deltaOrbVO);
 
   // Filtering fused Pose
-  if (medianFilterReady && recoverSteps > FILTER_WINDOW) {
+  bufferPose(poseBuffer, poseFilters, pose);
+  if (rejectionMode == GATING) {
+    // No fused pose filtering nor reset smoothing: their delay is what
+    // gating avoids
+    poseFiltered = pose;
+  } else if (medianFilterReady && recoverSteps > filterSpan) {
     // Filtering fused pose with median filter
-    std::vector<MedianFilter<double, FILTER_WINDOW>> poseFilters(pose.getPoseElements());
-    Eigen::MatrixXd qSamples(4,FILTER_WINDOW);
-
-    for (unsigned int j = 0; j < FILTER_WINDOW - 1; j++) {
-      poseBuffer[j] = poseBuffer[j+1];
-
-      // Fill the median filters buffers
-      poseFilters[Pose::X].addSample(poseBuffer[j].getTranslation()[Pose::X]);
-      poseFilters[Pose::Y].addSample(poseBuffer[j].getTranslation()[Pose::Y]);
-      poseFilters[Pose::Z].addSample(poseBuffer[j].getTranslation()[Pose::Z]);
-      qSamples(0,j) = poseBuffer[j].getRotation().w();
-      qSamples(1,j) = poseBuffer[j].getRotation().x();
-      qSamples(2,j) = poseBuffer[j].getRotation().y();
-      qSamples(3,j) = poseBuffer[j].getRotation().z();
-    }
-    poseBuffer[FILTER_WINDOW-1] = pose;
-    poseFilters[Pose::X].addSample(poseBuffer[FILTER_WINDOW-1].getTranslation()[Pose::X]);
-    poseFilters[Pose::Y].addSample(poseBuffer[FILTER_WINDOW-1].getTranslation()[Pose::Y]);
-    poseFilters[Pose::Z].addSample(poseBuffer[FILTER_WINDOW-1].getTranslation()[Pose::Z]);
-    qSamples(0,FILTER_WINDOW-1) = poseBuffer[FILTER_WINDOW-1].getRotation().w();
-    qSamples(1,FILTER_WINDOW-1) = poseBuffer[FILTER_WINDOW-1].getRotation().x();
-    qSamples(2,FILTER_WINDOW-1) = poseBuffer[FILTER_WINDOW-1].getRotation().y();
-    qSamples(3,FILTER_WINDOW-1) = poseBuffer[FILTER_WINDOW-1].getRotation().z();
-
-    poseFiltered.setTranslation(poseFilters[Pose::X].getMedian(), poseFilters[Pose::Y].getMedian(), poseFilters[Pose::Z].getMedian());
-    poseFiltered.setRotation(median_quaternions_weiszfeld(qSamples));
+    medianPose(poseBuffer, poseFilters, poseMedian, poseFiltered);
   } else {
-    if (poseBuffer.size() != FILTER_WINDOW)
-      poseBuffer.push_back(pose);
-    else {
-      for (unsigned int i = 0; i < FILTER_WINDOW - 1; i++)
-        poseBuffer[i] = poseBuffer[i+1];
-
-      poseBuffer[FILTER_WINDOW - 1] = pose;
-    }
     poseFiltered = pose;
-    if (poseBuffer.size() == FILTER_WINDOW)
+    if (bufferReady(poseBuffer, poseFilters))
       medianFilterReady = true;
 
-    // Smoothing trajectory during filter reset phase (for FILTER_WINDOW steps).
-    if (counter > FILTER_WINDOW) {
+    // Smoothing trajectory during filter reset phase (for W steps).
+    if (counter > W) {
       if (orbQoSFilterReset[0] != LOST) {
         double _x = poseFilteredPrev.getTranslation()[Pose::X] + (poseBuffer[poseBuffer.size()-2].getTranslation()[Pose::X] - pose.getTranslation()[Pose::X])*REDUCTION_FACTOR;
         double _y = poseFilteredPrev.getTranslation()[Pose::Y] + (poseBuffer[poseBuffer.size()-2].getTranslation()[Pose::Y] - pose.getTranslation()[Pose::Y])*REDUCTION_FACTOR;
@@ -401,16 +356,10 @@ bool Fuser::fuse(Pose camVO, Pose orbVO)
   }
 
   // Buffering orb QoS for recovery.
-  for (unsigned int i = 0; i < RECOVERY_BUFFER - 1; i++)
-    orbQoSPrev[i] = orbQoSPrev[i+1];
-
-  orbQoSPrev[RECOVERY_BUFFER - 1] = orbQoSNow;
+  orbQoSPrev.push(orbQoSNow);
 
   // Buffering orb QoS for filter reset and smoothing.
-  for (unsigned int i = 0; i < FILTER_WINDOW - 1; i++)
-    orbQoSFilterReset[i] = orbQoSFilterReset[i+1];
-
-  orbQoSFilterReset[FILTER_WINDOW - 1] = orbQoSNow;
+  orbQoSFilterReset.push(orbQoSNow);
 
   if (fuserStatus == UNINITIALIZED) {
     fuserStatus = RUNNING;
@@ -421,12 +370,140 @@ bool Fuser::fuse(Pose camVO, Pose orbVO)
   return(true);
 }
 
+// This function propagates the last fused pose with the T265 VO motion
+// accumulated since the last fuse() call, using the same additive delta
+// model of sensorFusion() with the camera VO only. It allows publishing the
+// fused pose at the T265 pose stream rate between two fusion steps.
+template <int W, int R>
+bool FuserT<W, R>::propagate(Pose camVO, Pose & propagated)
+{
+  if (fuserStatus == UNINITIALIZED)
+    return(false);
+
+  Eigen::Vector3d deltaT = camVO.getTranslation() - camVOPrev.getTranslation();
+  propagated.setTranslation(poseFiltered.getTranslation() + deltaT);
+  propagated.setRotation(poseFiltered.getRotation().w() + camVO.getRotation().w() - camVOPrev.getRotation().w(),
+                         poseFiltered.getRotation().x() + camVO.getRotation().x() - camVOPrev.getRotation().x(),
+                         poseFiltered.getRotation().y() + camVO.getRotation().y() - camVOPrev.getRotation().y(),
+                         poseFiltered.getRotation().z() + camVO.getRotation().z() - camVOPrev.getRotation().z());
+  propagated.setAccuracy(camVO.getAccuracy());
+
+  return(true);
+}
+
+// T265 measurement event: propagates the fused pose to the new sample, to be
+// published right away. Samples not newer than the latest one are duplicates
+// and are skipped.
+template <int W, int R>
+bool FuserT<W, R>::onCamPose(Pose camVO, double timestamp, Pose & fused)
+{
+  if (timestamp <= camLatestTs)
+    return(false);
+
+  camLatest   = camVO;
+  camLatestTs = timestamp;
+
+  return(propagate(camVO, fused));
+}
+
+// ORBSLAM2 measurement event: synchronizes the ORB pose history to the latest
+// T265 sample and runs a fusion step. Samples not newer than the latest one are
+// duplicates and are skipped, as well as ORB samples received before any
+// T265 sample.
+template <int W, int R>
+bool FuserT<W, R>::onOrbPose(Pose orbVO, double timestamp, Pose & fused)
+{
+  if (timestamp <= orbLatestTs || camLatestTs < 0)
+    return(false);
+
+  orbHistory.add(timestamp, orbVO);
+  orbLatestTs = timestamp;
+
+  Pose orbSynced;
+  orbHistory.interpolate(camLatestTs, orbSynced);
+  orbSynced.setAccuracy(orbVO.getAccuracy());
+
+  fuse(camLatest, orbSynced);
+  fused = poseFiltered;
+
+  return(true);
+}
+
+// Limits the iterations and the time spent by each quaternion median.
+template <int W, int R>
+void FuserT<W, R>::setMedianBudget(unsigned int maxIterations, std::chrono::microseconds timeBudget)
+{
+  medianMaxIterations = maxIterations;
+  medianTimeBudget    = timeBudget;
+}
+
+template <int W, int R>
+typename FuserT<W, R>::MedianStats FuserT<W, R>::getOrbMedianStats()
+{
+  return(orbMedian.stats);
+}
+
+template <int W, int R>
+typename FuserT<W, R>::MedianStats FuserT<W, R>::getFusedMedianStats()
+{
+  return(poseMedian.stats);
+}
+
+// Sets the translation median window and drops the samples of the median
+// filters, which are refilled before filtering again. It allocates memory:
+// call it at setup, not while fusing.
+template <int W, int R>
+void FuserT<W, R>::setFilterWindow(int window)
+{
+  filterWindow = window > 0 ? window : W;
+  filterSpan   = std::max(W, filterWindow);
+  recoverSteps = filterSpan + 1;
+  medianFilterReady = false;
+  for (int i = Pose::X; i <= Pose::Z; i++) {
+    orbFilters[i].resize(filterWindow);
+    poseFilters[i].resize(filterWindow);
+  }
+}
+
+template <int W, int R>
+int FuserT<W, R>::getFilterWindow()
+{
+  return(filterWindow);
+}
+
+// Selects the ORB outlier rejection, it can be switched at any time.
+template <int W, int R>
+void FuserT<W, R>::setOutlierRejection(outlierRejection mode)
+{
+  rejectionMode = mode;
+}
+
+template <int W, int R>
+typename FuserT<W, R>::outlierRejection FuserT<W, R>::getOutlierRejection()
+{
+  return((outlierRejection)rejectionMode);
+}
+
+template <int W, int R>
+typename FuserT<W, R>::GatingStats FuserT<W, R>::getGatingStats()
+{
+  return(gatingStats);
+}
+
+// Drops the ORB pose history, whose samples are not in the map frame of
+// the next ones (e.g. after an ORBSLAM2 reset).
+template <int W, int R>
+void FuserT<W, R>::restartOrb()
+{
+  orbHistory.reset();
+}
+
 // This function fuses ORBSLAM2 with T265 VO.
 // This function uses a blending algorithm to fuse ORBSLAM2 with T265 Visual Odometry.
-void Fuser::sensorFusion(std::vector<double> & deltaCamVO, std::vector<double> & deltaOrbVO)
+template <int W, int R>
+void FuserT<W, R>::sensorFusion(const PoseVector & deltaCamVO, const PoseVector & deltaOrbVO)
 {
   double alpha;
-  std::vector<double> delta(pose.getPoseElements());
 
   switch (camQoS)
   {
@@ -451,16 +528,112 @@ void Fuser::sensorFusion(std::vector<double> & deltaCamVO, std::vector<double> &
     alpha = 1.0;
   }
 
-  delta[Pose::X]  = deltaCamVO[Pose::X] * alpha + deltaOrbVO[Pose::X]*(1.0 - alpha);
-  delta[Pose::Y]  = deltaCamVO[Pose::Y] * alpha + deltaOrbVO[Pose::Y]*(1.0 - alpha);
-  delta[Pose::Z]  = deltaCamVO[Pose::Z] * alpha + deltaOrbVO[Pose::Z]*(1.0 - alpha);
-  delta[Pose::WQ] = deltaCamVO[Pose::WQ] * alpha + deltaOrbVO[Pose::WQ]*(1.0 - alpha);
-  delta[Pose::XQ] = deltaCamVO[Pose::XQ] * alpha + deltaOrbVO[Pose::XQ]*(1.0 - alpha);
-  delta[Pose::YQ] = deltaCamVO[Pose::YQ] * alpha + deltaOrbVO[Pose::YQ]*(1.0 - alpha);
-  delta[Pose::ZQ] = deltaCamVO[Pose::ZQ] * alpha + deltaOrbVO[Pose::ZQ]*(1.0 - alpha);
+  PoseVector delta = deltaCamVO * alpha + deltaOrbVO * (1.0 - alpha);
 
-  pose.setTranslation(posePrev.getTranslation()[Pose::X] + delta[Pose::X], posePrev.getTranslation()[Pose::Y] + delta[Pose::Y], posePrev.getTranslation()[Pose::Z] + delta[Pose::Z]);
+  pose.setTranslation(posePrev.getTranslation() + delta.template head<3>());
   pose.setRotation(posePrev.getRotation().w() + delta[Pose::WQ], posePrev.getRotation().x() + delta[Pose::XQ], posePrev.getRotation().y() + delta[Pose::YQ], posePrev.getRotation().z() + delta[Pose::ZQ]);
 
   return;
-}
\ No newline at end of file
+}
+
+// Chi-square test of an ORB delta against the T265 delta over the same
+// step, which predicts it. The innovation (translation and quaternion vector
+// part) is tested with its squared Mahalanobis distance, on a covariance
+// estimated online from the accepted innovations (exponential smoothing,
+// with a floor on the diagonal). The first GATING_WARMUP deltas are accepted
+// to initialize the covariance. After GATING_MAX_REJECTIONS consecutive
+// rejections the ORB trajectory is assumed to have jumped (e.g. a loop
+// closure) and has to be re-anchored.
+template <int W, int R>
+typename FuserT<W, R>::gatingResult FuserT<W, R>::gateOrbDelta(const PoseVector & deltaCamVO, const PoseVector & deltaOrbVO)
+{
+  GatingVector innovation;
+  innovation << deltaOrbVO.template head<3>() - deltaCamVO.template head<3>(), deltaOrbVO.template tail<3>() - deltaCamVO.template tail<3>();
+
+  GatingMatrix covariance = gatingCovariance;
+  covariance.diagonal().template head<3>().array() += GATING_MIN_SIGMA_T * GATING_MIN_SIGMA_T;
+  covariance.diagonal().template tail<3>().array() += GATING_MIN_SIGMA_Q * GATING_MIN_SIGMA_Q;
+  gatingStats.distance = innovation.dot(covariance.ldlt().solve(innovation));
+
+  bool warmUp = gatingSamples < GATING_WARMUP;
+  gatingStats.rejected = !warmUp && gatingStats.distance > GATING_CHI2;
+  if (gatingStats.rejected) {
+    gatingStats.rejections++;
+    if (++gatingConsecutive < GATING_MAX_REJECTIONS)
+      return(GATE_REJECT);
+
+    gatingConsecutive = 0;
+    return(GATE_REANCHOR);
+  }
+
+  // Accepted: update the innovation covariance
+  double rate = warmUp ? 1.0 / (gatingSamples + 1) : GATING_SMOOTHING;
+  gatingCovariance = (1.0 - rate) * gatingCovariance + rate * innovation * innovation.transpose();
+  gatingSamples++;
+  gatingConsecutive = 0;
+
+  return(GATE_ACCEPT);
+}
+
+// Appends a pose to a buffer and, unless the translation medians use the
+// sorting network, its translation components to the buffer sliding medians.
+template <int W, int R>
+void FuserT<W, R>::bufferPose(FixedRing<Pose, W> & buffer, SlidingMedian<double> * filters, Pose & sample)
+{
+  buffer.push(sample);
+  if (filterWindow == W)
+    return;
+
+  Eigen::Vector3d t = sample.getTranslation();
+  filters[Pose::X].addSample(t[Pose::X]);
+  filters[Pose::Y].addSample(t[Pose::Y]);
+  filters[Pose::Z].addSample(t[Pose::Z]);
+}
+
+// True once a buffer and its sliding medians hold full windows.
+template <int W, int R>
+bool FuserT<W, R>::bufferReady(const FixedRing<Pose, W> & buffer, const SlidingMedian<double> * filters)
+{
+  return(buffer.full() && (filterWindow == W || filters[Pose::X].isReady()));
+}
+
+// Median of the poses in a buffer: translation components with
+// medianTranslation(), rotations with the quaternion Weiszfeld median.
+template <int W, int R>
+void FuserT<W, R>::medianPose(const FixedRing<Pose, W> & buffer, const SlidingMedian<double> * filters, MedianState & state, Pose & median)
+{
+  QuaternionSamples qSamples;
+
+  for (int j = 0; j < W; j++) {
+    Pose sample = buffer[j];
+    qSamples(0,j) = sample.getRotation().w();
+    qSamples(1,j) = sample.getRotation().x();
+    qSamples(2,j) = sample.getRotation().y();
+    qSamples(3,j) = sample.getRotation().z();
+  }
+
+  median.setTranslation(medianTranslation(buffer, filters));
+  median.setRotation(median_quaternions_weiszfeld(qSamples, state));
+}
+
+// Translation median of a buffer. With the default window the sorting
+// network runs on the buffer: the x, y and z channels are packed in one
+// array (padded to 4 for vectorization) and sorted together. Other windows
+// read the buffer sliding medians.
+template <int W, int R>
+Eigen::Vector3d FuserT<W, R>::medianTranslation(const FixedRing<Pose, W> & buffer, const SlidingMedian<double> * filters)
+{
+  if (filterWindow != W)
+    return(Eigen::Vector3d(filters[Pose::X].getMedian(), filters[Pose::Y].getMedian(), filters[Pose::Z].getMedian()));
+
+  Eigen::Array4d samples[W];
+
+  for (int j = 0; j < W; j++) {
+    Pose sample = buffer[j];
+    samples[j] << sample.getTranslation().array(), 0.0;
+  }
+
+  return(networkMedian(samples).template head<3>().matrix());
+}
+
+template class FuserT<FILTER_WINDOW, RECOVERY_BUFFER>;
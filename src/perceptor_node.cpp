@@ -30,19 +30,28 @@ typedef struct
 } PointCloud;
 
 /**
- * @brief Creates a PerceptorNode.
- * 
- * @param pSLAM ORB_SLAM2 instance pointer.
- * @param realsense realsense instance pointer.
- * @param camera_pitch camera pitch angle in radians.
+ * @brief Creates a PerceptorNode: parameters, publishers and subscribers.
+ *        Processing begins with start(), once SLAM and frame source are ready,
+ *        so that the node can be created while they are being initialized.
  */
-PerceptorNode::PerceptorNode(ORB_SLAM2::System *pSLAM, RealSense *_realsense) : Node(PERCEPTORNAME), mpSLAM(pSLAM), realsense(_realsense)
+PerceptorNode::PerceptorNode() : Node(PERCEPTORNAME), mpSLAM(NULL), supervisor(NULL), slamRecovering(false), source(NULL), firstPosePublished(false), pipelineRunning(false)
 {
   // Declaring ROS2 parameters
   this->declare_parameter("perception_radius");  // in meters
   this->declare_parameter("camera_pitch"); // in rad
   this->declare_parameter("point_cloud_period"); // in ms
   this->declare_parameter("rgb_frame_period"); // in ms
+  this->declare_parameter("pose_rate_output"); // publish fused pose at T265 rate
+  this->declare_parameter("record_path"); // frameset recording file, empty to disable
+  this->declare_parameter("depth_decimation"); // depth downsampling factor, 1 to disable
+  this->declare_parameter("depth_min_distance"); // in meters, 0 to disable
+  this->declare_parameter("depth_max_distance"); // in meters, 0 to disable
+  this->declare_parameter("depth_spatial_filter");
+  this->declare_parameter("depth_temporal_filter");
+  this->declare_parameter("depth_hole_filling"); // 0 left, 1 farthest, 2 nearest, -1 to disable
+  this->declare_parameter("prediction_max_horizon"); // in ms, 0 to disable
+  this->declare_parameter("outlier_rejection"); // ORB outliers: "median" filters or "gating"
+  this->declare_parameter("filter_window"); // translation median filters window, in samples
 
   // Assign ROS2 parameters
   rclcpp::Parameter _perception_radius = this->get_parameter("perception_radius");
@@ -50,9 +59,22 @@ PerceptorNode::PerceptorNode(ORB_SLAM2::System *pSLAM, RealSense *_realsense) :
   rclcpp::Parameter _camera_pitch = this->get_parameter("camera_pitch");
   camera_pitch = (float)_camera_pitch.as_double();
   rclcpp::Parameter _point_cloud_period = this->get_parameter("point_cloud_period");
-  std::chrono::milliseconds pcPeriod{_point_cloud_period.as_int()};
+  pcPeriod = std::chrono::milliseconds(_point_cloud_period.as_int());
   rclcpp::Parameter _rgb_frame_period = this->get_parameter("rgb_frame_period");
-  std::chrono::milliseconds rgbPeriod{_rgb_frame_period.as_int()};
+  rgbPeriod = std::chrono::milliseconds(_rgb_frame_period.as_int());
+  rclcpp::Parameter _pose_rate_output = this->get_parameter("pose_rate_output");
+  poseRateOutput = _pose_rate_output.as_bool();
+  rclcpp::Parameter _record_path = this->get_parameter("record_path");
+  recordPath = _record_path.as_string();
+  depthFilters.decimation  = (int)this->get_parameter("depth_decimation").as_int();
+  depthFilters.minDistance = (float)this->get_parameter("depth_min_distance").as_double();
+  depthFilters.maxDistance = (float)this->get_parameter("depth_max_distance").as_double();
+  depthFilters.spatial     = this->get_parameter("depth_spatial_filter").as_bool();
+  depthFilters.temporal    = this->get_parameter("depth_temporal_filter").as_bool();
+  depthFilters.holeFilling = (int)this->get_parameter("depth_hole_filling").as_int();
+  maxPrediction = this->get_parameter("prediction_max_horizon").as_double();
+  std::string outlierRejection = this->get_parameter("outlier_rejection").as_string();
+  int filterWindow = (int)this->get_parameter("filter_window").as_int();
 
   // Initialize QoS profile.
   auto state_qos = rclcpp::QoS(rclcpp::QoSInitialization(qos_profile.history, qos_profile.depth), qos_profile);
@@ -67,12 +89,21 @@ PerceptorNode::PerceptorNode(ORB_SLAM2::System *pSLAM, RealSense *_realsense) :
 
   perceptor_pose_publisher_ = this->create_publisher<visualization_msgs::msg::Marker>("PerceptorPose", pc_qos);
   rgb_frame_publisher_ = this->create_publisher<sensor_msgs::msg::Image>("rgbImage", 10);
+  latency_publisher_ = this->create_publisher<std_msgs::msg::Float64>("PerceptorLatency", state_qos);
 
   // Create callback groups.
 #ifdef PX4
   timestamp_clbk_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
 #endif
-  vio_clbk_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  pose_clbk_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+  service_clbk_group_ = this->create_callback_group(rclcpp::CallbackGroupType::MutuallyExclusive);
+
+  // Initialize services.
+  pose_at_service_ = this->create_service<perceptor::srv::GetPoseAt>(
+      "GetPoseAt",
+      std::bind(&PerceptorNode::get_pose_at_callback, this, std::placeholders::_1, std::placeholders::_2),
+      rmw_qos_profile_services_default,
+      service_clbk_group_);
 
 #ifdef PX4
   // Subscribe to Timesync.
@@ -86,14 +117,57 @@ PerceptorNode::PerceptorNode(ORB_SLAM2::System *pSLAM, RealSense *_realsense) :
 #endif
 
   firstReset = true;
-  orbPrevTs = -1;
 
-  fuser = new Fuser();
+  if (filterWindow < 1) {
+    RCLCPP_WARN(this->get_logger(), "Invalid filter window %d, using %d samples", filterWindow, FILTER_WINDOW);
+    filterWindow = FILTER_WINDOW;
+  }
+  fuser = new Fuser(filterWindow);
+  if (outlierRejection == "gating")
+    fuser->setOutlierRejection(Fuser::GATING);
+  else if (outlierRejection != "median")
+    RCLCPP_WARN(this->get_logger(), "Unknown outlier rejection %s, using median filters", outlierRejection.c_str());
+  camLatest = rs2_pose();
+  predictor.setMaxHorizon(maxPrediction);
+
+  // Compute camera values.
+  cp_sin_ = sin(camera_pitch);
+  cp_cos_ = cos(camera_pitch);
+
+  RCLCPP_INFO(this->get_logger(), "Node created, camera pitch: %f [deg], perception radius: %f [m], point cloud period: %d [ms], rgb period: %d [ms], outlier rejection: %s, filter window: %d", camera_pitch * 180.0f / M_PIf32, perceptionRadius, (int)pcPeriod.count(), (int)rgbPeriod.count(), fuser->getOutlierRejection() == Fuser::GATING ? "gating" : "median", fuser->getFilterWindow());
+}
+
+/**
+ * @brief Starts processing: configures the frame source and activates timers.
+ *
+ * @param pSLAM ORB_SLAM2 instance pointer.
+ * @param _source frame source instance pointer (RealSense, replay or synthetic).
+ * @param _startTime process start time, for the time to first pose.
+ */
+void PerceptorNode::start(ORB_SLAM2::System *pSLAM, FrameSource *_source, std::chrono::steady_clock::time_point _startTime)
+{
+  mpSLAM = pSLAM;
+  source = _source;
+  startTime = _startTime;
+
+  // ORB-SLAM2 resets and relocalization run on the supervisor thread.
+  supervisor = new SlamSupervisor(mpSLAM);
+  supervisor->start();
 
-  // Activate timer for VIO publishing.
-  // VIO: 10 ms period.
-  // TODO: refactoring into thread
-  vio_timer_ = this->create_wall_timer(10ms, std::bind(&PerceptorNode::timer_vio_callback, this), vio_clbk_group_);
+  // Configure depth post-processing, it runs on the source worker thread.
+  if (depthFilters.enabled() && !source->setDepthPostProcessing(depthFilters))
+    RCLCPP_WARN(this->get_logger(), "Depth post-processing not supported by the frame source");
+
+  // Start recording framesets if requested.
+  if (!recordPath.empty() && !source->startRecording(recordPath))
+    RCLCPP_ERROR(this->get_logger(), "Unable to record framesets to %s", recordPath.c_str());
+
+  // Start the VIO pipeline, driven by the frame source.
+  startPipeline();
+
+  // Activate timer for T265 pose stream draining.
+  // Pose: 1 ms period, the T265 produces samples at 200 Hz.
+  pose_timer_ = this->create_wall_timer(1ms, std::bind(&PerceptorNode::timer_pose_callback, this), pose_clbk_group_);
 
   // Activate timer for PC publishing
   pc_timer_  = this->create_wall_timer(pcPeriod, std::bind(&PerceptorNode::timer_pc_callback, this));
@@ -101,21 +175,36 @@ PerceptorNode::PerceptorNode(ORB_SLAM2::System *pSLAM, RealSense *_realsense) :
   // Activate timer for Down Camera images publishing
   rgb_timer_ = this->create_wall_timer(rgbPeriod, std::bind(&PerceptorNode::timer_rgb_callback, this));
 
-  // Compute camera values.
-  cp_sin_ = sin(camera_pitch);
-  cp_cos_ = cos(camera_pitch);
+  RCLCPP_INFO(this->get_logger(), "Node started");
+}
 
-  RCLCPP_INFO(this->get_logger(), "Node initialized, camera pitch: %f [deg], perception radius: %f [m], point cloud period: %d [ms], rgb period: %d [ms]", camera_pitch * 180.0f / M_PIf32, perceptionRadius, pcPeriod, rgbPeriod);
+/**
+ * @brief Stops processing threads, before the SLAM system is shut down.
+ */
+void PerceptorNode::stop(void)
+{
+  stopPipeline();
+
+  if (supervisor != NULL)
+  {
+    supervisor->stop();
+    delete supervisor;
+    supervisor = NULL;
+  }
 }
 
 /**
- * @brief Stores the latest PX4 timestamp.
+ * @brief Stores the latest PX4 timestamp, and fits the PX4 time base on it:
+ *        PX4 timestamps [us] are paired with their arrival time in the common
+ *        time base, and the clock model (offset and skew) follows the lower
+ *        envelope of the transport delays.
  * 
  * @param msg Timesync message pointer.
  */
 #ifdef PX4
 void PerceptorNode::timestamp_callback(const px4_msgs::msg::Timesync::SharedPtr msg)
 {
+  px4Clock.observe(msg->timestamp * 1e-3, ClockDomain::now());
   timestamp_.store(msg->timestamp, std::memory_order_release);
 }
 #endif
@@ -169,82 +258,143 @@ void PerceptorNode::poseConversion(Pose & pose, rs2_pose & rs2Pose) {
 }
 
 /**
- * @brief Publishes the latest VIO data to PX4 topics.
+ * @brief Feeds every T265 pose sample to the fuser as soon as it is drained,
+ *        and publishes the propagated pose at the pose stream rate (200 Hz)
+ *        if requested.
  */
-void PerceptorNode::timer_vio_callback(void)
+void PerceptorNode::timer_pose_callback(void)
 {
-  //
-  // Sensor fusion ready to go!
-  //
-  realsense->run();
-  rs2_pose pose = realsense->getPose();
-
-  cv::Mat irMatrix    = realsense->getIRLeftMatrix();
-  cv::Mat depthMatrix = realsense->getDepthMatrix();
-  rgbMatrix           = realsense->getColorMatrix();
-
-  // ORBSLAM2 fails if it's running! We need to reset it.
-  if (!firstReset && mpSLAM->GetTrackingState() == ORB_SLAM2::Tracking::LOST) {
-    mpSLAM->Reset();
+  rs2_pose camPose;
+  rs2_time_t camTs;
+
+  while (source->popPoseSample(camPose, camTs))
+  {
+    Pose _camPose, propagatedPose;
+    poseConversion(camPose, _camPose);
+
+    fuserMutex.lock();
+    bool valid = fuser->onCamPose(_camPose, camTs, propagatedPose);
+    if (valid)
+    {
+      poseHistory.add(camTs, propagatedPose);
+      camLatest = camPose;
+    }
+    fuserMutex.unlock();
+
+    if (valid && poseRateOutput)
+      publishFusedPose(propagatedPose, camTs, camPose);
   }
+}
 
-  // Pass the IR Left and Depth frames to the SLAM system
-  ORB_SLAM2::HPose cameraPose = mpSLAM->TrackIRD(irMatrix, depthMatrix, realsense->getIRLeftTimestamp());
-  unsigned int ORBState = (mpSLAM->GetTrackingState() == ORB_SLAM2::Tracking::OK) ? 3 : 0;
+/**
+ * @brief Looks up the fused pose at a past time, for in-process consumers.
+ *
+ * @param t Timestamp in the common time base of the frame source [ms].
+ * @param pose Fused pose at t, interpolated from the pose history.
+ * @return false if t is outside the pose history.
+ */
+bool PerceptorNode::getPoseAt(rs2_time_t t, Pose & pose)
+{
+  return(poseHistory.getPoseAt(t, pose));
+}
 
-  pcMutex.lock();
-  poseConversion(cameraPose, ORBState, orbPose);
-  pcMutex.unlock();
-
-  // The first time I receive a valid ORB-SLAM2 sample, I have to reset the T265 tracker.
-  if (!cameraPose.empty() && firstReset) {
-    realsense->resetPoseTrack();
-    realsense->run();
-    pose = realsense->getPose();
-    firstReset = false;
+/**
+ * @brief Serves fused pose lookups at a past ROS time.
+ *
+ * @param request Service request, with the ROS time of the pose.
+ * @param response Service response, with the pose if it is in the history.
+ */
+void PerceptorNode::get_pose_at_callback(const std::shared_ptr<perceptor::srv::GetPoseAt::Request> request,
+                                         std::shared_ptr<perceptor::srv::GetPoseAt::Response> response)
+{
+  // ROS (system) time to the common time base of the pose history.
+  rs2_time_t t = request->stamp.sec * 1e3 + request->stamp.nanosec * 1e-6 + ClockDomain::systemToCommon();
+
+  Pose pose;
+  response->success = getPoseAt(t, pose);
+  if (!response->success)
+  {
+    double t0 = 0.0, t1 = 0.0;
+    poseHistory.getRange(t0, t1);
+    RCLCPP_DEBUG(this->get_logger(), "GetPoseAt: %.3f [ms] outside the pose history [%.3f, %.3f] [ms]", t, t0, t1);
+    return;
   }
 
-  Pose _camPose, _orbPose, orbSyncedPose, fusedPose;
-  poseConversion(pose, _camPose);
-  poseConversion(orbPose, _orbPose);
+  response->pose.position.x    = pose.getTranslation()[Pose::X];
+  response->pose.position.y    = pose.getTranslation()[Pose::Y];
+  response->pose.position.z    = pose.getTranslation()[Pose::Z];
+  response->pose.orientation.w = pose.getRotation().w();
+  response->pose.orientation.x = pose.getRotation().x();
+  response->pose.orientation.y = pose.getRotation().y();
+  response->pose.orientation.z = pose.getRotation().z();
+  response->accuracy = pose.getAccuracy();
+}
 
-  // Sensor fusion
-  fuser->synchronizer(orbPrevTs, realsense->getIRLeftTimestamp(), realsense->getPoseTimestamp(), orbPrevPose, _orbPose, orbSyncedPose);
-  orbSyncedPose.setAccuracy(_orbPose.getAccuracy());
-  fuser->fuse(_camPose, orbSyncedPose);
-  fusedPose = fuser->getFusedPose();
+/**
+ * @brief Publishes a fused pose to PX4 and as a visualization marker,
+ *        predicted forward to the publishing time, and its latency.
+ *
+ * @param pose Fused pose to be published.
+ * @param poseTs Timestamp of the fused pose, in the common time base [ms].
+ * @param camPose T265 sample the fused pose refers to, for its velocities.
+ */
+void PerceptorNode::publishFusedPose(Pose & pose, rs2_time_t poseTs, const rs2_pose & camPose)
+{
+  if (!firstPosePublished.exchange(true))
+  {
+    std::chrono::duration<double> ttfp = std::chrono::steady_clock::now() - startTime;
+    RCLCPP_INFO(this->get_logger(), "Time to first pose: %.3f [s]", ttfp.count());
+  }
 
-  pcMutex.lock();
-  pointCloud = mpSLAM->getMap();
-  camRecover = fuser->getRecoveredPose();
-  pcMutex.unlock();
+  // Compensate the pipeline latency: predict the pose at the publishing time.
+  Pose fusedPose;
+  rs2_time_t publishTs = ClockDomain::now();
+  predictor.update(pose, poseTs, camPose);
+  double horizon = predictor.predict(publishTs, fusedPose);
+  Eigen::Vector3d velocity = predictor.getVelocity();
+  Eigen::Vector3d bodyRates = fusedPose.getRotation().conjugate() * predictor.getAngularVelocity();
 
-  // Save the previous orb pose and timestamp
-  poseConversion(orbPose, orbPrevPose);
-  orbPrevTs = realsense->getIRLeftTimestamp();
+  // Publish the latency of the fused pose, before prediction.
+  {
+    std_msgs::msg::Float64 msg{};
+    msg.set__data(publishTs - poseTs);
+    latency_publisher_->publish(msg);
+  }
+  RCLCPP_DEBUG(this->get_logger(), "Fused pose latency: %.3f [ms], predicted: %.3f [ms]", publishTs - poseTs, horizon);
 
 #ifdef PX4
   uint64_t msg_timestamp = timestamp_.load(std::memory_order_acquire);
+  uint64_t msg_timestamp_sample = msg_timestamp;
   px4_msgs::msg::VehicleVisualOdometry message{};
 
-  // Set message timestamp (from Timesync).
+  // Map the publishing time and the time the pose refers to (capture time,
+  // plus the prediction horizon) into the PX4 time base. Until the clock
+  // model is fitted, both are the latest Timesync value, and so is any
+  // mapped value that is negative or too far from it (e.g. a frame source
+  // stamping in a device clock).
+  if (px4Clock.isValid())
+  {
+    const double timesync = (double)msg_timestamp;
+    const double mapped        = px4Clock.fromCommon(publishTs) * 1e3;
+    const double mapped_sample = px4Clock.fromCommon(poseTs + horizon) * 1e3;
+    if (std::isfinite(mapped) && mapped >= 0.0 && std::abs(mapped - timesync) <= PX4_MAX_SKEW)
+      msg_timestamp = (uint64_t)std::llround(mapped);
+    if (std::isfinite(mapped_sample) && mapped_sample >= 0.0 && std::abs(mapped_sample - timesync) <= PX4_MAX_SKEW)
+      msg_timestamp_sample = (uint64_t)std::llround(mapped_sample);
+  }
+
+  // Set message timestamps.
   message.set__timestamp(msg_timestamp);
-  message.set__timestamp_sample(msg_timestamp);
+  message.set__timestamp_sample(msg_timestamp_sample);
 
   // Set local frames of reference (these SHOULD be NED for PX4).
   message.set__local_frame(px4_msgs::msg::VehicleVisualOdometry::LOCAL_FRAME_NED);
   message.set__velocity_frame(px4_msgs::msg::VehicleVisualOdometry::LOCAL_FRAME_NED);
 
-  // Set unnecessary data fields: velocities and covariances.
+  // Set unnecessary data fields: covariances.
   message.q_offset[0] = NAN;
   message.pose_covariance[0] = NAN;
   message.pose_covariance[15] = NAN;
-  message.set__vx(NAN);
-  message.set__vy(NAN);
-  message.set__vz(NAN);
-  message.set__rollspeed(NAN);
-  message.set__pitchspeed(NAN);
-  message.set__yawspeed(NAN);
   message.velocity_covariance[0] = NAN;
   message.velocity_covariance[15] = NAN;
 
@@ -283,19 +433,21 @@ void PerceptorNode::timer_vio_callback(void)
     message.set__y(fusedPose.getTranslation()[1]);
     message.set__z(fusedPose.getTranslation()[2]);
     message.q = {(float)fusedPose.getRotation().w(), (float)fusedPose.getRotation().x(), (float)fusedPose.getRotation().y(), (float)fusedPose.getRotation().z()};
+
+    // Velocities used for the prediction: linear in the local frame, angular
+    // in the body frame.
+    message.set__vx(velocity[0]);
+    message.set__vy(velocity[1]);
+    message.set__vz(velocity[2]);
+    message.set__rollspeed(bodyRates[0]);
+    message.set__pitchspeed(bodyRates[1]);
+    message.set__yawspeed(bodyRates[2]);
   }
 
   // Send it!
   vio_publisher_->publish(message);
 #endif
 
-  // Publish latest tracking state.
-  {
-    std_msgs::msg::Int32 msg{};
-    msg.set__data(_camPose.getAccuracy());
-    state_publisher_->publish(msg);
-  }
-
   // Publish fused pose for marker visualization.
   {
     visualization_msgs::msg::Marker msg{};
@@ -411,10 +563,14 @@ void PerceptorNode::timer_pc_callback(void)
  */
 void PerceptorNode::timer_rgb_callback()
 {
-  cv_bridge::CvImagePtr cv_ptr;
-  if (!rgbMatrix.empty())
+  // The handle copy keeps the frame alive while it is being converted
+  rgbMutex.lock();
+  FrameHandle frame = rgbFrame;
+  rgbMutex.unlock();
+
+  if (!frame.empty())
   {
-    sensor_msgs::msg::Image::SharedPtr msg = cv_bridge::CvImage(std_msgs::msg::Header(), "bgr8", rgbMatrix).toImageMsg();
+    sensor_msgs::msg::Image::SharedPtr msg = cv_bridge::CvImage(std_msgs::msg::Header(), "bgr8", frame.view).toImageMsg();
     rgb_frame_publisher_->publish(*msg.get());
   }
 }
\ No newline at end of file
@@ -0,0 +1,247 @@
+/**
+ * @brief Perceptor ROS2 node VIO pipeline stages.
+ *
+ * @author Fabrizio Romanelli <fabrizio.romanelli@gmail.com>
+ * @author Roberto Masocco <robmasocco@gmail.com>
+ *
+ * @date Apr 23, 2022
+ */
+
+#include "perceptor_ros2.hpp"
+
+using namespace std::chrono_literals;
+
+/**
+ * @brief Starts the VIO pipeline: capture, tracking, fusion and publishing
+ *        stages, each on its own thread. Capture hands the latest frameset
+ *        to tracking through a latest-wins slot, later stages are connected
+ *        by bounded queues, so frameset N+1 is captured while N is being
+ *        tracked and throughput is limited by the slowest stage only.
+ */
+void PerceptorNode::startPipeline(void)
+{
+  if (pipelineRunning.exchange(true))
+    return;
+
+  stages.emplace_back(&PerceptorNode::captureStage, this);
+  stages.emplace_back(&PerceptorNode::trackingStage, this);
+  stages.emplace_back(&PerceptorNode::fusionStage, this);
+  stages.emplace_back(&PerceptorNode::publishStage, this);
+}
+
+/**
+ * @brief Stops the VIO pipeline and joins its stages.
+ */
+void PerceptorNode::stopPipeline(void)
+{
+  if (!pipelineRunning.exchange(false))
+    return;
+
+  capturedSlot.wake();
+  trackedQueue.wake();
+  fusedQueue.wake();
+  for (auto & stage : stages)
+    stage.join();
+  stages.clear();
+
+  RCLCPP_INFO(this->get_logger(), "VIO pipeline stopped, dropped framesets: %zu tracking, %zu fusion, %zu publishing",
+              capturedSlot.dropped(), trackedQueue.dropped(), fusedQueue.dropped());
+}
+
+/**
+ * @brief Capture stage: pins every new frameset with its T265 pose.
+ */
+void PerceptorNode::captureStage(void)
+{
+  while (pipelineRunning.load(std::memory_order_acquire))
+  {
+    // Frames are acquired by the source capture threads: poll for a new one
+    if (!source->tryGetLatest())
+    {
+      std::this_thread::sleep_for(500us);
+      continue;
+    }
+
+    // Pinned frames: they stay valid while in use, whatever the source does
+    CapturedFrames captured;
+    captured.irFrame    = source->getIRLeftHandle();
+    captured.depthFrame = source->getDepthHandle();
+    captured.pose       = source->getPose();
+    captured.poseTs     = source->getPoseTimestamp();
+
+    rgbMutex.lock();
+    rgbFrame = source->getColorHandle();
+    rgbMutex.unlock();
+
+    capturedSlot.push(captured);
+  }
+}
+
+/**
+ * @brief Tracking stage: runs ORB-SLAM2, or hands frames to the supervisor
+ *        while it is recovering.
+ */
+void PerceptorNode::trackingStage(void)
+{
+  CapturedFrames captured;
+
+  while (pipelineRunning.load(std::memory_order_acquire))
+  {
+    if (!capturedSlot.pop(captured, 100ms))
+      continue;
+
+    TrackedFrames tracked;
+    tracked.camPose    = captured.pose;
+    tracked.irTs       = captured.irFrame.timestamp;
+    tracked.poseTs     = captured.poseTs;
+    tracked.orbRestart = false;
+
+    bool slamTracking = supervisor->isTracking();
+    if (slamTracking)
+    {
+      // Tracking handed back by the supervisor: restart ORB interpolation.
+      if (slamRecovering)
+      {
+        RCLCPP_INFO(this->get_logger(), "ORB-SLAM2 tracking recovered");
+        slamRecovering = false;
+        tracked.orbRestart = true;
+      }
+
+      // Pass the IR Left and Depth frames to the SLAM system
+      ORB_SLAM2::HPose cameraPose = mpSLAM->TrackIRD(captured.irFrame.view, captured.depthFrame.view, captured.irFrame.timestamp);
+      unsigned int ORBState = (mpSLAM->GetTrackingState() == ORB_SLAM2::Tracking::OK) ? 3 : 0;
+
+      pcMutex.lock();
+      poseConversion(cameraPose, ORBState, orbPose);
+      pcMutex.unlock();
+
+      // The first time I receive a valid ORB-SLAM2 sample, I have to reset the T265 tracker.
+      // The reset is non-blocking: the latest T265 pose becomes the origin,
+      // and re-zeroed poses come with the next captured framesets.
+      if (!cameraPose.empty() && firstReset) {
+        source->resetPoseTrack();
+        poseResetTs = captured.poseTs;
+        firstReset = false;
+      }
+
+      // ORBSLAM2 fails if it's running! We need to reset it: the supervisor
+      // resets and relocalizes it in background.
+      if (!firstReset && mpSLAM->GetTrackingState() == ORB_SLAM2::Tracking::LOST) {
+        RCLCPP_WARN(this->get_logger(), "ORB-SLAM2 tracking lost, resetting");
+        pcMutex.lock();
+        pointCloud.clear();
+        pcMutex.unlock();
+        supervisor->requestReset();
+        slamRecovering = true;
+        slamTracking = false;
+      }
+    }
+    else
+    {
+      // SLAM is recovering: feed it, and fuse the T265 pose only.
+      supervisor->submit(captured.irFrame, captured.depthFrame);
+      pcMutex.lock();
+      orbPose.tracker_confidence = 0;
+      pcMutex.unlock();
+    }
+
+    pcMutex.lock();
+    if (slamTracking)
+      pointCloud = mpSLAM->getMap();
+    tracked.orbPose = orbPose;
+    pcMutex.unlock();
+
+    // Frames are released here, fusion only needs poses
+    captured = CapturedFrames();
+
+    // T265 pose captured before the re-zero: in the previous origin, not fused
+    if (poseResetTs >= 0 && tracked.poseTs <= poseResetTs)
+      continue;
+
+    trackedQueue.push(tracked);
+  }
+}
+
+/**
+ * @brief Fusion stage: every new ORB-SLAM2 pose triggers a fusion step with
+ *        the latest T265 pose. The T265 pose of the frameset is only fed to
+ *        the fuser if timer_pose_callback has not delivered it yet.
+ */
+void PerceptorNode::fusionStage(void)
+{
+  TrackedFrames tracked;
+
+  while (pipelineRunning.load(std::memory_order_acquire))
+  {
+    if (!trackedQueue.pop(tracked, 100ms))
+      continue;
+
+    Pose _camPose, _orbPose, propagatedPose;
+    poseConversion(tracked.camPose, _camPose);
+    poseConversion(tracked.orbPose, _orbPose);
+
+    // Sensor fusion
+    FusedFrames fused;
+    fuserMutex.lock();
+    if (tracked.orbRestart)
+      fuser->restartOrb();
+    if (fuser->onCamPose(_camPose, tracked.poseTs, propagatedPose))
+      camLatest = tracked.camPose;
+    bool valid = fuser->onOrbPose(_orbPose, tracked.irTs, fused.fusedPose);
+    fused.fusedTs = fuser->getFusedTimestamp();
+    fused.camPose = camLatest;
+    if (valid)
+      poseHistory.add(fused.fusedTs, fused.fusedPose);
+    Pose recoveredPose = fuser->getRecoveredPose();
+    Fuser::MedianStats orbStats = fuser->getOrbMedianStats();
+    Fuser::MedianStats fusedStats = fuser->getFusedMedianStats();
+    Fuser::GatingStats gatingStats = fuser->getGatingStats();
+    bool gating = fuser->getOutlierRejection() == Fuser::GATING;
+    fuserMutex.unlock();
+
+    // Duplicate ORB-SLAM2 sample, nothing new to publish
+    if (!valid)
+      continue;
+
+    if (gating)
+      RCLCPP_DEBUG(this->get_logger(), "ORB gating: distance %.3f%s, %u rejected",
+                   gatingStats.distance, gatingStats.rejected ? " (rejected)" : "", gatingStats.rejections);
+    else
+      RCLCPP_DEBUG(this->get_logger(), "Quaternion medians: ORB %u iterations%s, fused %u iterations%s",
+                   orbStats.iterations, orbStats.converged ? "" : " (budget exhausted)",
+                   fusedStats.iterations, fusedStats.converged ? "" : " (budget exhausted)");
+
+    pcMutex.lock();
+    camRecover = recoveredPose;
+    pcMutex.unlock();
+
+    fused.camAccuracy = _camPose.getAccuracy();
+    fusedQueue.push(fused);
+  }
+}
+
+/**
+ * @brief Publishing stage: publishes the tracking state and the fused pose.
+ */
+void PerceptorNode::publishStage(void)
+{
+  FusedFrames fused;
+
+  while (pipelineRunning.load(std::memory_order_acquire))
+  {
+    if (!fusedQueue.pop(fused, 100ms))
+      continue;
+
+    // Publish latest tracking state.
+    {
+      std_msgs::msg::Int32 msg{};
+      msg.set__data(fused.camAccuracy);
+      state_publisher_->publish(msg);
+    }
+
+    // Publish the fused pose at the image rate, unless it is published at the
+    // T265 pose stream rate by timer_pose_callback.
+    if (!poseRateOutput)
+      publishFusedPose(fused.fusedPose, fused.fusedTs, fused.camPose);
+  }
+}
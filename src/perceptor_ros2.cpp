@@ -9,9 +9,14 @@
 
 #include <iostream>
 #include <cstdio>
+#include <cstring>
 #include <thread>
+#include <future>
+#include <chrono>
 
 #include "realsense.hpp"
+#include "frameReplay.hpp"
+#include "synthetic.hpp"
 #include "perceptor_ros2.hpp"
 
 #ifdef SMT
@@ -24,6 +29,55 @@
 #pragma message "Activated publishers and subscribers for PX4 topics"
 #endif
 
+/**
+ * @brief Creates the frame source selected by the optional third argument:
+ *        realsense (default), synthetic[:WIDTHxHEIGHT@FPS] or replay:FILE[:fast].
+ *
+ * @param spec Source specification, NULL for the default.
+ * @return New frame source, NULL if the specification is invalid.
+ */
+FrameSource *createFrameSource(const char *spec)
+{
+  if (spec == NULL || strcmp(spec, "realsense") == 0)
+    return new RealSense(RealSense::MULTI);
+
+  if (strncmp(spec, "synthetic", 9) == 0)
+  {
+    unsigned int width = 640, height = 480;
+    double fps = 30.0;
+    if (spec[9] == ':' && sscanf(spec + 10, "%ux%u@%lf", &width, &height, &fps) < 2)
+      return NULL;
+    return new SyntheticSource(width, height, fps);
+  }
+
+  if (strncmp(spec, "replay:", 7) == 0)
+  {
+    std::string path(spec + 7);
+    FrameReplay::pacingMode pacing = FrameReplay::REALTIME;
+    size_t sep = path.rfind(':');
+    if (sep != std::string::npos && path.substr(sep + 1) == "fast")
+    {
+      pacing = FrameReplay::FAST;
+      path = path.substr(0, sep);
+    }
+    return new FrameReplay(path, pacing);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Prints the duration of a startup phase.
+ *
+ * @param phase Phase name.
+ * @param t0 Phase start time.
+ */
+void reportPhase(const char *phase, std::chrono::steady_clock::time_point t0)
+{
+  std::chrono::duration<double> dt = std::chrono::steady_clock::now() - t0;
+  printf("%s ready in %.3f s\n", phase, dt.count());
+}
+
 /* The works. */
 int main(int argc, char **argv)
 {
@@ -31,14 +85,32 @@ int main(int argc, char **argv)
   setvbuf(stdout, NULL, _IONBF, 0);
   setvbuf(stderr, NULL, _IONBF, 0);
 
-  // Create ORB_SLAM2 instance.
-  ORB_SLAM2::System SLAM(argv[1], argv[2], ORB_SLAM2::System::RGBD, false, false);
+  std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
 
-  // Initialize RealSense cameras
-  RealSense::sModality mode = RealSense::MULTI;
-  RealSense *realsense = new RealSense(mode);
+  // Startup phases are independent and run concurrently: ORB_SLAM2 system
+  // construction (vocabulary and settings loading), frame source bring-up
+  // (RealSense cameras by default) and ROS 2 node creation.
+  std::future<ORB_SLAM2::System *> slamFuture = std::async(std::launch::async, [argv]() {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    ORB_SLAM2::System *pSLAM = new ORB_SLAM2::System(argv[1], argv[2], ORB_SLAM2::System::RGBD, false, false);
+    reportPhase("ORB_SLAM2 system", t0);
+    return pSLAM;
+  });
 
-  // Initialize ROS 2 connection and MT executor.
+  const char *sourceSpec = (argc > 3 && argv[3][0] != '-') ? argv[3] : NULL;
+  std::future<FrameSource *> sourceFuture = std::async(std::launch::async, [sourceSpec]() {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    FrameSource *source = createFrameSource(sourceSpec);
+    if (source != NULL)
+    {
+      source->startCapture();
+      reportPhase("Frame source", t0);
+    }
+    return source;
+  });
+
+  // Initialize ROS 2 connection, MT executor and PerceptorNode.
+  std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
   rclcpp::init(argc, argv);
 #ifdef SMT
   rclcpp::executors::MultiThreadedExecutor perceptor_mt_executor;
@@ -46,9 +118,22 @@ int main(int argc, char **argv)
   rclcpp::executors::SingleThreadedExecutor perceptor_st_executor;
 #endif
   std::cout << "ROS 2 executor initialized" << std::endl;
+  auto perceptor_node_ptr = std::make_shared<PerceptorNode>();
+  reportPhase("ROS 2 node", t0);
+
+  // Wait for the other phases.
+  std::unique_ptr<ORB_SLAM2::System> SLAM(slamFuture.get());
+  FrameSource *source = sourceFuture.get();
+  if (source == NULL)
+  {
+    std::cerr << "Invalid frame source: " << (sourceSpec ? sourceSpec : "realsense") << std::endl;
+    rclcpp::shutdown();
+    SLAM->Shutdown();
+    exit(EXIT_FAILURE);
+  }
+  reportPhase("Startup", startTime);
 
-  // Create PerceptorNode.
-  auto perceptor_node_ptr = std::make_shared<PerceptorNode>(&SLAM, realsense);
+  perceptor_node_ptr->start(SLAM.get(), source, startTime);
 
 #ifdef SMT
   perceptor_mt_executor.add_node(perceptor_node_ptr);
@@ -59,8 +144,9 @@ int main(int argc, char **argv)
 #endif
 
   // Done!
+  perceptor_node_ptr->stop();
   rclcpp::shutdown();
-  SLAM.Shutdown();
-  delete(realsense);
+  SLAM->Shutdown();
+  delete(source);
   exit(EXIT_SUCCESS);
 }
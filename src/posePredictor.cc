@@ -0,0 +1,75 @@
+#include "posePredictor.hpp"
+
+PosePredictor::PosePredictor(double _maxHorizon) : maxHorizon(_maxHorizon), valid(false), fusedTs(0.0), velocity(Eigen::Vector3d::Zero()), angularVelocity(Eigen::Vector3d::Zero())
+{
+}
+
+PosePredictor::~PosePredictor()
+{}
+
+// Maximum prediction horizon [ms], 0 disables the prediction.
+void PosePredictor::setMaxHorizon(double _maxHorizon)
+{
+  maxHorizon = _maxHorizon;
+}
+
+// New fused pose at timestamp [ms], with the T265 sample it refers to.
+void PosePredictor::update(Pose pose, double timestamp, const rs2_pose & cam)
+{
+  if (cam.tracker_confidence > 0)
+  {
+    // T265 reference frame to fused frame
+    Eigen::Quaterniond camRotation(cam.rotation.w, cam.rotation.x, cam.rotation.y, cam.rotation.z);
+    Eigen::Quaterniond camToFused = pose.getRotation() * camRotation.normalized().conjugate();
+    velocity        = camToFused * Eigen::Vector3d(cam.velocity.x, cam.velocity.y, cam.velocity.z);
+    angularVelocity = camToFused * Eigen::Vector3d(cam.angular_velocity.x, cam.angular_velocity.y, cam.angular_velocity.z);
+  }
+  else if (valid && timestamp > fusedTs)
+  {
+    velocity = (pose.getTranslation() - fused.getTranslation()) / ((timestamp - fusedTs) * 1e-3);
+    angularVelocity.setZero();
+  }
+  else
+  {
+    velocity.setZero();
+    angularVelocity.setZero();
+  }
+
+  fused   = pose;
+  fusedTs = timestamp;
+  valid   = true;
+}
+
+// Predicts the latest fused pose at timestamp [ms]. Returns the prediction
+// horizon [ms], 0 if the pose was not predicted: no fused pose yet, or
+// timestamp not within the maximum horizon (e.g. a replayed stream).
+double PosePredictor::predict(double timestamp, Pose & predicted)
+{
+  predicted = fused;
+
+  double horizon = timestamp - fusedTs;
+  if (!valid || horizon <= 0.0 || horizon > maxHorizon)
+    return(0.0);
+
+  double dt = horizon * 1e-3;
+  predicted.setTranslation(fused.getTranslation() + velocity * dt);
+
+  // Angular velocity in the fused (world) frame: the rotation is applied on
+  // the left.
+  Eigen::Vector3d rotationVector = angularVelocity * dt;
+  double angle = rotationVector.norm();
+  if (angle > 0.0)
+    predicted.setRotation(Eigen::Quaterniond(Eigen::AngleAxisd(angle, rotationVector / angle)) * fused.getRotation());
+
+  return(horizon);
+}
+
+Eigen::Vector3d PosePredictor::getVelocity()
+{
+  return(velocity);
+}
+
+Eigen::Vector3d PosePredictor::getAngularVelocity()
+{
+  return(angularVelocity);
+}
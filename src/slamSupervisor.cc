@@ -0,0 +1,121 @@
+#include "slamSupervisor.hpp"
+
+SlamSupervisor::SlamSupervisor(ORB_SLAM2::System *pSLAM) : mpSLAM(pSLAM), running(false), state(TRACKING), resets(0), resetRequested(false), pending(false)
+{
+}
+
+SlamSupervisor::~SlamSupervisor()
+{
+  stop();
+}
+
+void SlamSupervisor::start()
+{
+  if (running.exchange(true))
+    return;
+
+  worker = std::thread(&SlamSupervisor::loop, this);
+}
+
+// running is cleared under mtx, so that the worker cannot miss the wakeup
+// between its predicate check and going to sleep.
+void SlamSupervisor::stop()
+{
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (!running.exchange(false))
+      return;
+  }
+
+  cv.notify_one();
+  worker.join();
+}
+
+// Called by the owner of the SLAM system (TRACKING state only): from now on
+// the worker owns it until tracking is handed back.
+void SlamSupervisor::requestReset()
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  state.store(RESETTING, std::memory_order_release);
+  resetRequested = true;
+  pending = false;
+  cv.notify_one();
+}
+
+// Latest frames for relocalization, older unprocessed ones are dropped
+void SlamSupervisor::submit(const FrameHandle & ir, const FrameHandle & depth)
+{
+  std::lock_guard<std::mutex> lock(mtx);
+  pendingIR    = ir;
+  pendingDepth = depth;
+  pending      = true;
+  cv.notify_one();
+}
+
+SlamSupervisor::supervisorState SlamSupervisor::getState()
+{
+  return((supervisorState)state.load(std::memory_order_acquire));
+}
+
+bool SlamSupervisor::isTracking()
+{
+  return(state.load(std::memory_order_acquire) == TRACKING);
+}
+
+unsigned int SlamSupervisor::getResetCount()
+{
+  return(resets.load(std::memory_order_relaxed));
+}
+
+void SlamSupervisor::loop()
+{
+  unsigned int healthy = 0;
+
+  while (running.load(std::memory_order_acquire))
+  {
+    FrameHandle ir, depth;
+    bool reset = false;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [this] { return(resetRequested || pending || !running.load(std::memory_order_relaxed)); });
+
+      if (!running.load(std::memory_order_relaxed))
+        break;
+
+      if (resetRequested) {
+        resetRequested = false;
+        reset = true;
+      } else {
+        ir      = pendingIR;
+        depth   = pendingDepth;
+        pending = false;
+        pendingIR.reset();
+        pendingDepth.reset();
+      }
+    }
+
+    if (reset) {
+      mpSLAM->Reset();
+      resets.fetch_add(1, std::memory_order_relaxed);
+      healthy = 0;
+      state.store(RECOVERING, std::memory_order_release);
+      continue;
+    }
+
+    // Frames submitted while tracking are ignored
+    if (state.load(std::memory_order_acquire) != RECOVERING)
+      continue;
+
+    // The first frame after Reset() performs the actual reset
+    mpSLAM->TrackIRD(ir.view, depth.view, ir.timestamp);
+
+    if (mpSLAM->GetTrackingState() == ORB_SLAM2::Tracking::OK)
+      healthy++;
+    else
+      healthy = 0;
+
+    // Hand tracking back to the owner
+    if (healthy >= HEALTHY_FRAMES)
+      state.store(TRACKING, std::memory_order_release);
+  }
+}
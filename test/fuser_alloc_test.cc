@@ -0,0 +1,111 @@
+// Checks that the Fuser does not allocate memory once warmed up: fusion
+// steps in median and gating mode, with the default and a runtime filter
+// window, spikes rejected by the gating and ORB recovery after a tracking
+// loss must not reach the global operator new.
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "fuser.hpp"
+
+static std::atomic<bool> counting(false);
+static std::atomic<unsigned long> allocations(0);
+
+void * operator new(std::size_t size)
+{
+  if (counting.load(std::memory_order_relaxed))
+    allocations.fetch_add(1, std::memory_order_relaxed);
+  void * p = std::malloc(size ? size : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return(p);
+}
+
+void * operator new[](std::size_t size)
+{
+  return(operator new(size));
+}
+
+void operator delete(void * p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+  std::free(p);
+}
+
+void operator delete(void * p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+void operator delete[](void * p, std::size_t) noexcept
+{
+  std::free(p);
+}
+
+// Feeds the fuser with k steps of a helix at 30 Hz, the T265 drifting and
+// ORB jumping every 37 samples. Samples in [lostFrom, lostTo) are ORB LOST.
+static void run(Fuser & fuser, int k0, int k1, int lostFrom, int lostTo)
+{
+  for (int k = k0; k < k1; k++) {
+    double t = k / 30.0;
+    Eigen::Vector3d p(std::cos(t), std::sin(t), 0.1 * t);
+    Eigen::Quaterniond q(Eigen::AngleAxisd(t, Eigen::Vector3d::UnitZ()));
+
+    Pose cam(p + Eigen::Vector3d(0.002 * t, 0.0, 0.0), q);
+    cam.setAccuracy(Fuser::OK);
+
+    Eigen::Vector3d po = p;
+    if (k % 37 == 0)
+      po += Eigen::Vector3d(0.3, -0.2, 0.1);
+    Pose orb(po, q);
+    orb.setAccuracy((k >= lostFrom && k < lostTo) ? Fuser::LOST : Fuser::OK);
+
+    Pose fused;
+    fuser.onCamPose(cam, t * 1e3, fused);
+    fuser.onOrbPose(orb, t * 1e3, fused);
+    fuser.fuse(cam, orb);
+  }
+}
+
+static bool check(Fuser::outlierRejection mode, int window, const char * name)
+{
+  Fuser * fuser = new Fuser(window);
+  fuser->setOutlierRejection(mode);
+
+  // Warm-up, with a first recovery
+  run(*fuser, 0, 300, 100, 110);
+
+  Eigen::Vector3d recoveredBefore = fuser->getRecoveredPose().getTranslation();
+  unsigned int rejectionsBefore   = fuser->getGatingStats().rejections;
+
+  allocations.store(0);
+  counting.store(true);
+  run(*fuser, 300, 900, 500, 510);
+  counting.store(false);
+
+  bool recovered = fuser->getRecoveredPose().getTranslation() != recoveredBefore;
+  bool rejected  = fuser->getGatingStats().rejections > rejectionsBefore;
+  delete fuser;
+
+  bool ok = (allocations.load() == 0) && recovered && (mode != Fuser::GATING || rejected);
+  std::cout << name << ", window " << window << ": " << allocations.load() << " allocations, recovery " << (recovered ? "run" : "not run")
+            << ", rejections " << (rejected ? "run" : "not run") << (ok ? " [OK]" : " [FAILED]") << std::endl;
+  return(ok);
+}
+
+int main()
+{
+  bool ok = true;
+  for (int window : {FILTER_WINDOW, 9}) {
+    ok = check(Fuser::MEDIAN, window, "median") && ok;
+    ok = check(Fuser::GATING, window, "gating") && ok;
+  }
+
+  return(ok ? 0 : 1);
+}